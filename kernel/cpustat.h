@@ -0,0 +1,8 @@
+// Per-hart idle accounting, as reported by the cpustat
+// system call. Times are in timer cycles.
+struct cpustat {
+  uint64 hart;
+  uint64 time;             // when the sample was taken
+  uint64 idle;             // time spent waiting in wfi
+  uint64 wakeups;          // times it left wfi
+};
@@ -2,6 +2,10 @@ struct buf;
 struct context;
 struct file;
 struct inode;
+struct vma;
+struct kmem_cache;
+struct memstat;
+struct namespace;
 struct pipe;
 struct proc;
 struct spinlock;
@@ -63,8 +67,21 @@ void            ramdiskrw(struct buf*);
 
 // kalloc.c
 void*           kalloc(void);
+void*           kalloc_zeroed(void);
+int             kzerofill(void);
 void            kfree(void *);
 void            kinit(void);
+void*           kalloc_order(int);
+void            kfree_order(void *, int);
+void            ksplit(void *, int);
+void            kmemstat(struct memstat *);
+void            kdup(void *);
+int             krefcnt(void *);
+
+// slab.c
+void            kmem_cache_init(struct kmem_cache*, char*, uint);
+void*           kmem_cache_alloc(struct kmem_cache*);
+void            kmem_cache_free(struct kmem_cache*, void*);
 
 // log.c
 void            initlog(int, struct superblock*);
@@ -72,7 +89,14 @@ void            log_write(struct buf*);
 void            begin_op(void);
 void            end_op(void);
 
+// pagecache.c
+void            pcinit(void);
+char*           pcget(struct inode*, uint, uint);
+void            pcinval(struct inode*);
+int             pcpages(void);
+
 // pipe.c
+void            pipeinit(void);
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, uint64, int);
@@ -93,6 +117,12 @@ void            proc_mapstacks(pagetable_t);
 pagetable_t     proc_pagetable(struct proc *);
 void            proc_freepagetable(pagetable_t, uint64);
 int             kill(int);
+int             nskill(int);
+struct proc*    findproc(struct namespace*, int);
+int             nspid(struct proc*, struct namespace*);
+struct namespace* nsdup(struct namespace*);
+void            nsput(struct namespace*);
+int             getppid(void);
 int             killed(struct proc*);
 void            setkilled(struct proc*);
 struct cpu*     mycpu(void);
@@ -109,6 +139,16 @@ void            userinit(void);
 int             wait(uint64);
 void            wakeup(void*);
 void            yield(void);
+void            schedtick(void);
+void            schedboost(void);
+int             setpriority(int, int, int);
+int             setnsweight(int, int);
+int             nsreserve(struct namespace*, int, int);
+void            nsrelease(struct namespace*, int, int);
+int             setnslimit(int, int, int);
+int             nsusage(int, uint64);
+int             nskillall(int);
+int             wait_ns(int, uint64, uint64);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
@@ -116,10 +156,16 @@ void            procdump(void);
 
 int		        ps_list(int limit, uint64 pids, int global);
 int		        ps_info(int pid, uint64 psinfo);
+int		        ps_snapshot(uint64 addr, int max, int flags);
+void            ps_publish(struct proc*);
 uint64          sys_uptime(void);
 // swtch.S
 void            swtch(struct context*, struct context*);
 
+// usercopy.S
+int             ucopy(void *, void *, uint64);
+int             ucopystr(char *, char *, uint64);
+
 // spinlock.c
 void            acquire(struct spinlock*);
 int             holding(struct spinlock*);
@@ -168,6 +214,8 @@ int             uartgetc(void);
 // vm.c
 void            kvminit(void);
 void            kvminithart(void);
+pagetable_t     kvmproc(void);
+void            uvmmirror(struct proc *);
 void            kvmmap(pagetable_t, uint64, uint64, uint64, int);
 int             mappages(pagetable_t, uint64, uint64, uint64, int);
 pagetable_t     uvmcreate(void);
@@ -175,14 +223,32 @@ void            uvmfirst(pagetable_t, uchar *, uint);
 uint64          uvmalloc(pagetable_t, uint64, uint64, int);
 uint64          uvmdealloc(pagetable_t, uint64, uint64);
 int             uvmcopy(pagetable_t, pagetable_t, uint64);
+int             uvmshare(pagetable_t, pagetable_t, uint64, uint64, int);
+int             uvmrelease(pagetable_t, uint64, uint64);
+int             uvmsplitends(pagetable_t, uint64, uint64);
+int             uvmcow(pagetable_t, uint64);
+int             uvmlazy(pagetable_t, uint64);
+void            uvmdirty(pagetable_t, uint64);
 void            uvmfree(pagetable_t, uint64);
-void            uvmunmap(pagetable_t, uint64, uint64, int);
-void            uvmclear(pagetable_t, uint64);
+int             uvmunmap(pagetable_t, uint64, uint64, int);
+int             uvmclear(pagetable_t, uint64);
 pte_t *         walk(pagetable_t, uint64, int);
 uint64          walkaddr(pagetable_t, uint64);
 int             copyout(pagetable_t, uint64, char *, uint64);
 int             copyin(pagetable_t, char *, uint64, uint64);
 int             copyinstr(pagetable_t, char *, uint64, uint64);
+void            uvmprefault(pagetable_t, uint64, uint64);
+
+// vma.c
+struct vma*     vmaadd(struct vma*, uint64, uint64, int);
+struct vma*     vmafind(struct vma*, uint64);
+struct vma*     vmaoverlap(struct vma*, uint64, uint64);
+char*           vmapage(struct vma*, uint64);
+void            vmadup(struct vma*, struct vma*);
+int             vmacopy(pagetable_t, pagetable_t, struct vma*);
+void            vmaput(pagetable_t, struct vma*);
+uint64          mmap(uint64, uint64, int, int, struct file*, uint);
+int             munmap(uint64, uint64);
 
 // plic.c
 void            plicinit(void);
@@ -6,8 +6,10 @@
 #include "proc.h"
 #include "defs.h"
 #include "elf.h"
-
-static int loadseg(pde_t *, uint64, struct inode *, uint, uint);
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "nslimit.h"
 
 int flags2perm(int flags)
 {
@@ -28,8 +30,12 @@ exec(char *path, char **argv)
   struct elfhdr elf;
   struct inode *ip;
   struct proghdr ph;
+  struct vma vmas[NVMA], *v;
   pagetable_t pagetable = 0, oldpagetable;
   struct proc *p = myproc();
+  int charged = 0;
+
+  memset(vmas, 0, sizeof(vmas));
 
   begin_op();
 
@@ -49,7 +55,8 @@ exec(char *path, char **argv)
   if((pagetable = proc_pagetable(p)) == 0)
     goto bad;
 
-  // Load program into memory.
+  // Record where each segment comes from in the file;
+  // its pages are read in as they are first touched.
   for(i=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
     if(readi(ip, 0, (uint64)&ph, off, sizeof(ph)) != sizeof(ph))
       goto bad;
@@ -61,12 +68,22 @@ exec(char *path, char **argv)
       goto bad;
     if(ph.vaddr % PGSIZE != 0)
       goto bad;
-    uint64 sz1;
-    if((sz1 = uvmalloc(pagetable, sz, ph.vaddr + ph.memsz, flags2perm(ph.flags))) == 0)
+    if(ph.vaddr + ph.memsz > USTATS)
+      goto bad;
+    if(ph.off + ph.filesz < ph.off || ph.off + ph.filesz > ip->size)
       goto bad;
-    sz = sz1;
-    if(loadseg(pagetable, ph.vaddr, ip, ph.off, ph.filesz) < 0)
+    if(ph.memsz == 0)
+      continue;
+    if(vmaoverlap(vmas, ph.vaddr, PGROUNDUP(ph.vaddr + ph.memsz)))
+      goto bad;
+    v = vmaadd(vmas, ph.vaddr, PGROUNDUP(ph.vaddr + ph.memsz), flags2perm(ph.flags));
+    if(v == 0)
       goto bad;
+    v->ip = idup(ip);
+    v->off = ph.off;
+    v->filesz = ph.filesz;
+    if(ph.vaddr + ph.memsz > sz)
+      sz = ph.vaddr + ph.memsz;
   }
   iunlockput(ip);
   end_op();
@@ -75,15 +92,19 @@ exec(char *path, char **argv)
   p = myproc();
   uint64 oldsz = p->sz;
 
-  // Allocate two pages at the next page boundary.
-  // Make the first inaccessible as a stack guard.
-  // Use the second as the user stack.
+  // Take two pages at the next page boundary.
+  // Leave the first unmapped as a stack guard.
+  // Allocate the second as the user stack.
   sz = PGROUNDUP(sz);
   uint64 sz1;
-  if((sz1 = uvmalloc(pagetable, sz, sz + 2*PGSIZE, PTE_W)) == 0)
+  if(nsreserve(p->ns, NSLIM_PAGES, 1) < 0)
+    goto bad;
+  charged = 1;
+  if((sz1 = uvmalloc(pagetable, sz + PGSIZE, sz + 2*PGSIZE, PTE_W)) == 0)
     goto bad;
   sz = sz1;
-  uvmclear(pagetable, sz-2*PGSIZE);
+  if(uvmclear(pagetable, sz-2*PGSIZE) < 0)
+    goto bad;
   sp = sz;
   stackbase = sp - PGSIZE;
 
@@ -119,48 +140,37 @@ exec(char *path, char **argv)
     if(*s == '/')
       last = s+1;
   safestrcpy(p->name, last, sizeof(p->name));
+  // the old image's pages are freed below.
+  nsrelease(p->ns, NSLIM_PAGES, p->heap_pages);
+  acquire(&p->lock);
+  // only the stack is resident, and it was charged above;
+  // the program's pages fault in later.
+  p->heap_pages = 1;
+  ps_publish(p);
+  release(&p->lock);
     
   // Commit to the user image.
   oldpagetable = p->pagetable;
   p->pagetable = pagetable;
+  uvmmirror(p);
   p->sz = sz;
   p->trapframe->epc = elf.entry;  // initial program counter = main
   p->trapframe->sp = sp; // initial stack pointer
+  vmaput(oldpagetable, p->vmas);
   proc_freepagetable(oldpagetable, oldsz);
+  memmove(p->vmas, vmas, sizeof(vmas));
 
   return argc; // this ends up in a0, the first argument to main(argc, argv)
 
  bad:
+  if(charged)
+    nsrelease(p->ns, NSLIM_PAGES, 1);
   if(pagetable)
     proc_freepagetable(pagetable, sz);
   if(ip){
     iunlockput(ip);
     end_op();
   }
+  vmaput(0, vmas);
   return -1;
 }
-
-// Load a program segment into pagetable at virtual address va.
-// va must be page-aligned
-// and the pages from va to va+sz must already be mapped.
-// Returns 0 on success, -1 on failure.
-static int
-loadseg(pagetable_t pagetable, uint64 va, struct inode *ip, uint offset, uint sz)
-{
-  uint i, n;
-  uint64 pa;
-
-  for(i = 0; i < sz; i += PGSIZE){
-    pa = walkaddr(pagetable, va + i);
-    if(pa == 0)
-      panic("loadseg: address should exist");
-    if(sz - i < PGSIZE)
-      n = sz - i;
-    else
-      n = PGSIZE;
-    if(readi(ip, 0, (uint64)pa, offset+i, n) != n)
-      return -1;
-  }
-  
-  return 0;
-}
@@ -12,35 +12,40 @@
 #include "file.h"
 #include "stat.h"
 #include "proc.h"
+#include "slab.h"
+#include "nslimit.h"
 
 struct devsw devsw[NDEV];
 struct {
-  struct spinlock lock;
-  struct file file[NFILE];
+  struct spinlock lock;      // protects ref
+  struct kmem_cache cache;
 } ftable;
 
 void
 fileinit(void)
 {
   initlock(&ftable.lock, "ftable");
+  kmem_cache_init(&ftable.cache, "file", sizeof(struct file));
 }
 
-// Allocate a file structure.
+// Allocate a file structure, charged to the
+// current process's namespace.
 struct file*
 filealloc(void)
 {
+  struct namespace *ns = myproc()->ns;
   struct file *f;
 
-  acquire(&ftable.lock);
-  for(f = ftable.file; f < ftable.file + NFILE; f++){
-    if(f->ref == 0){
-      f->ref = 1;
-      release(&ftable.lock);
-      return f;
-    }
+  if(nsreserve(ns, NSLIM_FILES, 1) < 0)
+    return 0;
+  if((f = kmem_cache_alloc(&ftable.cache)) == 0){
+    nsrelease(ns, NSLIM_FILES, 1);
+    return 0;
   }
-  release(&ftable.lock);
-  return 0;
+  f->type = FD_NONE;
+  f->ref = 1;
+  f->ns = nsdup(ns);
+  return f;
 }
 
 // Increment ref count for file f.
@@ -69,9 +74,10 @@ fileclose(struct file *f)
     return;
   }
   ff = *f;
-  f->ref = 0;
-  f->type = FD_NONE;
   release(&ftable.lock);
+  kmem_cache_free(&ftable.cache, f);
+  nsrelease(ff.ns, NSLIM_FILES, 1);
+  nsput(ff.ns);
 
   if(ff.type == FD_PIPE){
     pipeclose(ff.pipe, ff.writable);
@@ -111,6 +117,9 @@ fileread(struct file *f, uint64 addr, int n)
   if(f->readable == 0)
     return -1;
 
+  // the copies below happen with locks held.
+  uvmprefault(myproc()->pagetable, addr, n);
+
   if(f->type == FD_PIPE){
     r = piperead(f->pipe, addr, n);
   } else if(f->type == FD_DEVICE){
@@ -139,6 +148,9 @@ filewrite(struct file *f, uint64 addr, int n)
   if(f->writable == 0)
     return -1;
 
+  // the copies below happen with locks held.
+  uvmprefault(myproc()->pagetable, addr, n);
+
   if(f->type == FD_PIPE){
     ret = pipewrite(f->pipe, addr, n);
   } else if(f->type == FD_DEVICE){
@@ -1,6 +1,8 @@
 // Physical memory allocator, for user processes,
 // kernel stacks, page-table pages,
-// and pipe buffers. Allocates whole 4096-byte pages.
+// and pipe buffers. Allocates power-of-two runs of
+// 4096-byte pages with a buddy system; single pages
+// come from per-cpu caches in front of it.
 
 #include "types.h"
 #include "param.h"
@@ -8,25 +10,142 @@
 #include "spinlock.h"
 #include "riscv.h"
 #include "defs.h"
+#include "memstat.h"
 
 void freerange(void *pa_start, void *pa_end);
 
 extern char end[]; // first address after kernel.
                    // defined by kernel.ld.
 
+// a free block; lives in the block's first page.
 struct run {
   struct run *next;
+  struct run *prev;
 };
 
+#define NPAGE ((PHYSTOP - KERNBASE) / PGSIZE)
+#define PA2PG(pa) (((uint64)(pa) - KERNBASE) / PGSIZE)
+#define PG2PA(i) (KERNBASE + (uint64)(i) * PGSIZE)
+
+// per-page state. free and order are only meaningful for
+// the first page of a free block. ref counts the page
+// tables sharing an allocated page (see kdup()).
+struct page {
+  uchar free;
+  uchar order;
+  int ref;
+};
+
+// the global pool: lists of free blocks by order.
+// a block of order k is 2^k pages, aligned to its size
+// relative to KERNBASE; its buddy is the other half of
+// the enclosing block of order k+1.
 struct {
   struct spinlock lock;
-  struct run *freelist;
+  struct run *freelist[NORDER];
+  struct page pages[NPAGE];
+  uint64 total;
+  uint64 nfree;
 } kmem;
 
+static void
+buddy_push(struct run *r, int order)
+{
+  struct page *pg = &kmem.pages[PA2PG(r)];
+
+  pg->free = 1;
+  pg->order = order;
+  r->prev = 0;
+  r->next = kmem.freelist[order];
+  if(r->next)
+    r->next->prev = r;
+  kmem.freelist[order] = r;
+}
+
+static void
+buddy_unlink(struct run *r, int order)
+{
+  kmem.pages[PA2PG(r)].free = 0;
+  if(r->prev)
+    r->prev->next = r->next;
+  else
+    kmem.freelist[order] = r->next;
+  if(r->next)
+    r->next->prev = r->prev;
+}
+
+// take a block of 2^order pages from the free lists,
+// splitting a larger one if needed. caller holds kmem.lock.
+static void *
+buddy_alloc(int order)
+{
+  struct run *r;
+  int k;
+
+  for(k = order; k < NORDER && kmem.freelist[k] == 0; k++)
+    ;
+  if(k == NORDER)
+    return 0;
+  r = kmem.freelist[k];
+  buddy_unlink(r, k);
+  // give back the upper halves.
+  while(k > order){
+    k--;
+    buddy_push((struct run*)((char*)r + (PGSIZE << k)), k);
+  }
+  kmem.nfree -= 1 << order;
+  return r;
+}
+
+// return a block of 2^order pages to the free lists,
+// merging it with its buddy for as long as the buddy
+// is free too. caller holds kmem.lock.
+static void
+buddy_free(void *pa, int order)
+{
+  uint64 i = PA2PG(pa);
+
+  kmem.nfree += 1 << order;
+  while(order < NORDER-1){
+    uint64 b = i ^ (1UL << order);
+    if(b >= NPAGE || !kmem.pages[b].free || kmem.pages[b].order != order)
+      break;
+    buddy_unlink((struct run*)PG2PA(b), order);
+    i &= ~(1UL << order);
+    order++;
+  }
+  buddy_push((struct run*)PG2PA(i), order);
+}
+
+// each cpu keeps a cache of free pages so that most kalloc()
+// and kfree() calls don't touch kmem.lock. pages move between
+// a cache and kmem KBATCH at a time. the lock is only contended
+// when another cpu steals from the cache.
+#define KBATCH  32
+#define KCACHE  (2*KBATCH)   // kfree drains a batch above this
+
+struct kcache {
+  struct spinlock lock;
+  struct run *freelist;
+  int n;
+} kcache[NCPU];
+
+// pages known to be all zeros, for kalloc_zeroed(). idle
+// harts fill the pool in kzerofill(); its pages keep the
+// reference kalloc() gave them.
+struct {
+  struct spinlock lock;
+  struct run *freelist;
+  int n;
+} kzero;
+
 void
 kinit()
 {
   initlock(&kmem.lock, "kmem");
+  initlock(&kzero.lock, "kzero");
+  for(int i = 0; i < NCPU; i++)
+    initlock(&kcache[i].lock, "kcache");
   freerange(end, (void*)PHYSTOP);
 }
 
@@ -35,31 +154,136 @@ freerange(void *pa_start, void *pa_end)
 {
   char *p;
   p = (char*)PGROUNDUP((uint64)pa_start);
-  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
-    kfree(p);
+  acquire(&kmem.lock);
+  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE){
+    buddy_free(p, 0);
+    kmem.total++;
+  }
+  release(&kmem.lock);
+}
+
+// Move up to n pages from the front of *from to the front of *to.
+// Returns the number of pages moved.
+static int
+kmove(struct run **from, struct run **to, int n)
+{
+  struct run *first, *last;
+  int i;
+
+  if((first = *from) == 0 || n <= 0)
+    return 0;
+  last = first;
+  for(i = 1; i < n && last->next; i++)
+    last = last->next;
+  *from = last->next;
+  last->next = *to;
+  *to = first;
+  return i;
+}
+
+// Give up to n pages from cache kc back to the buddy lists.
+// Caller holds kc->lock.
+static void
+kdrain(struct kcache *kc, int n)
+{
+  struct run *r;
+
+  acquire(&kmem.lock);
+  while(n-- > 0 && (r = kc->freelist) != 0){
+    kc->freelist = r->next;
+    kc->n--;
+    buddy_free(r, 0);
+  }
+  release(&kmem.lock);
+}
+
+// Take pages from other cpus' caches, half of the first
+// non-empty one found, into cache kc. Returns the number
+// of pages taken.
+static int
+ksteal(struct kcache *kc)
+{
+  struct run *stolen = 0;
+  int n = 0;
+
+  for(struct kcache *v = kcache; v < &kcache[NCPU] && n == 0; v++){
+    if(v == kc || v->freelist == 0)
+      continue;
+    acquire(&v->lock);
+    n = kmove(&v->freelist, &stolen, (v->n + 1) / 2);
+    v->n -= n;
+    release(&v->lock);
+  }
+  if(n){
+    acquire(&kc->lock);
+    kmove(&stolen, &kc->freelist, n);
+    kc->n += n;
+    release(&kc->lock);
+  }
+  return n;
+}
+
+// Take a page from the zero pool, or return 0 if it's empty.
+static struct run *
+kzerotake(void)
+{
+  struct run *r;
+
+  acquire(&kzero.lock);
+  if((r = kzero.freelist) != 0){
+    kzero.freelist = r->next;
+    kzero.n--;
+  }
+  release(&kzero.lock);
+  if(r)
+    r->next = 0;  // the only word that wasn't zero
+  return r;
+}
+
+static void
+kcheck(void *pa, int order)
+{
+  if(order < 0 || order >= NORDER ||
+     ((uint64)pa - KERNBASE) % ((uint64)PGSIZE << order) != 0 ||
+     (char*)pa < end || (uint64)pa + ((uint64)PGSIZE << order) > PHYSTOP)
+    panic("kfree");
 }
 
 // Free the page of physical memory pointed at by pa,
 // which normally should have been returned by a
-// call to kalloc().  (The exception is when
-// initializing the allocator; see kinit above.)
+// call to kalloc().
 void
 kfree(void *pa)
 {
   struct run *r;
+  struct kcache *kc;
 
-  if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
-    panic("kfree");
+  kcheck(pa, 0);
+
+  // drop a reference; only the last one frees the page.
+  int ref = __sync_sub_and_fetch(&kmem.pages[PA2PG(pa)].ref, 1);
+  if(ref > 0)
+    return;
+  if(ref < 0)
+    panic("kfree: ref");
 
+#if KJUNK
   // Fill with junk to catch dangling refs.
   memset(pa, 1, PGSIZE);
+#endif
 
   r = (struct run*)pa;
 
-  acquire(&kmem.lock);
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  release(&kmem.lock);
+  push_off();
+  kc = &kcache[cpuid()];
+  acquire(&kc->lock);
+  r->next = kc->freelist;
+  kc->freelist = r;
+  kc->n++;
+  if(kc->n > KCACHE)
+    kdrain(kc, KBATCH);
+  release(&kc->lock);
+  pop_off();
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -69,14 +293,192 @@ void *
 kalloc(void)
 {
   struct run *r;
+  struct kcache *kc;
 
-  acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
-  release(&kmem.lock);
+  push_off();
+  kc = &kcache[cpuid()];
+  for(;;){
+    acquire(&kc->lock);
+    if(kc->freelist == 0){
+      // refill a batch from the global pool.
+      acquire(&kmem.lock);
+      while(kc->n < KBATCH && (r = buddy_alloc(0)) != 0){
+        r->next = kc->freelist;
+        kc->freelist = r;
+        kc->n++;
+      }
+      release(&kmem.lock);
+    }
+    r = kc->freelist;
+    if(r){
+      kc->freelist = r->next;
+      kc->n--;
+    }
+    release(&kc->lock);
 
-  if(r)
+    // the global pool is empty too; try the other cpus.
+    if(r || ksteal(kc) == 0)
+      break;
+  }
+  pop_off();
+
+  if(r){
+#if KJUNK
     memset((char*)r, 5, PGSIZE); // fill with junk
+#endif
+    kmem.pages[PA2PG(r)].ref = 1;
+  } else {
+    // zeroed pages are free memory too.
+    r = kzerotake();
+  }
   return (void*)r;
 }
+
+// Allocate one page of physical memory filled with zeros,
+// preferably one that an idle hart already cleared.
+void *
+kalloc_zeroed(void)
+{
+  void *pa;
+
+  if((pa = kzerotake()) == 0 && (pa = kalloc()) != 0)
+    memset(pa, 0, PGSIZE);
+  return pa;
+}
+
+// Clear one more page for the zero pool, unless it is full.
+// Called by scheduler() when there is nothing to run, so it
+// does a page at a time. Returns 0 if there was nothing to do.
+int
+kzerofill(void)
+{
+  struct run *r;
+
+  if(__atomic_load_n(&kzero.n, __ATOMIC_RELAXED) >= NZEROPAGES)
+    return 0;
+  if((r = kalloc()) == 0)
+    return 0;
+  memset(r, 0, PGSIZE);
+  acquire(&kzero.lock);
+  r->next = kzero.freelist;
+  kzero.freelist = r;
+  kzero.n++;
+  release(&kzero.lock);
+  return 1;
+}
+
+// Add a reference to page pa, which must have come from
+// kalloc(); kfree() frees it only after the last one is dropped.
+void
+kdup(void *pa)
+{
+  kcheck(pa, 0);
+  if(__sync_fetch_and_add(&kmem.pages[PA2PG(pa)].ref, 1) < 1)
+    panic("kdup");
+}
+
+// Number of references to page pa.
+int
+krefcnt(void *pa)
+{
+  return __atomic_load_n(&kmem.pages[PA2PG(pa)].ref, __ATOMIC_SEQ_CST);
+}
+
+// Allocate 2^order physically contiguous pages, aligned
+// to their size. Returns 0 if no such block is free.
+void *
+kalloc_order(int order)
+{
+  void *pa;
+  struct run *r;
+
+  if(order == 0)
+    return kalloc();
+  if(order < 0 || order >= NORDER)
+    return 0;
+
+  acquire(&kmem.lock);
+  pa = buddy_alloc(order);
+  release(&kmem.lock);
+  if(pa == 0){
+    // pages sitting in the per-cpu caches and the zero
+    // pool can't merge; hand them all back and try once more.
+    while((r = kzerotake()) != 0)
+      kfree(r);
+    for(struct kcache *kc = kcache; kc < &kcache[NCPU]; kc++){
+      acquire(&kc->lock);
+      kdrain(kc, kc->n);
+      release(&kc->lock);
+    }
+    acquire(&kmem.lock);
+    pa = buddy_alloc(order);
+    release(&kmem.lock);
+  }
+
+  if(pa){
+#if KJUNK
+    memset(pa, 5, PGSIZE << order); // fill with junk
+#endif
+    kmem.pages[PA2PG(pa)].ref = 1;
+  }
+  return pa;
+}
+
+// Free a block returned by kalloc_order(order).
+void
+kfree_order(void *pa, int order)
+{
+  if(order == 0){
+    kfree(pa);
+    return;
+  }
+  kcheck(pa, order);
+  // drop a reference; fork() shares user megapages.
+  int ref = __sync_sub_and_fetch(&kmem.pages[PA2PG(pa)].ref, 1);
+  if(ref > 0)
+    return;
+  if(ref < 0)
+    panic("kfree_order: ref");
+#if KJUNK
+  memset(pa, 1, PGSIZE << order);
+#endif
+  acquire(&kmem.lock);
+  buddy_free(pa, order);
+  release(&kmem.lock);
+}
+
+// Turn a block returned by kalloc_order(order) into 2^order
+// pages that are each freed with kfree().
+void
+ksplit(void *pa, int order)
+{
+  uint64 i = PA2PG(pa);
+
+  kcheck(pa, order);
+  if(kmem.pages[i].ref != 1)
+    panic("ksplit: ref");
+  for(uint64 j = 1; j < (1UL << order); j++)
+    kmem.pages[i + j].ref = 1;
+}
+
+// Fill in a report of free memory.
+void
+kmemstat(struct memstat *ms)
+{
+  struct run *r;
+
+  memset(ms, 0, sizeof(*ms));
+  for(struct kcache *kc = kcache; kc < &kcache[NCPU]; kc++){
+    acquire(&kc->lock);
+    ms->cached += kc->n;
+    release(&kc->lock);
+  }
+  acquire(&kmem.lock);
+  ms->zeroed = kzero.n;
+  ms->total = kmem.total;
+  ms->free = kmem.nfree;
+  for(int k = 0; k < NORDER; k++)
+    for(r = kmem.freelist[k]; r; r = r->next)
+      ms->nblock[k]++;
+  release(&kmem.lock);
+}
@@ -29,6 +29,7 @@
 
 // core local interruptor (CLINT), which contains the timer.
 #define CLINT 0x2000000L
+#define CLINT_MSIP(hartid) (CLINT + 4*(hartid))  // software interrupt
 #define CLINT_MTIMECMP(hartid) (CLINT + 0x4000 + 8*(hartid))
 #define CLINT_MTIME (CLINT + 0xBFF8) // cycles since boot.
 
@@ -64,6 +65,13 @@
 //   fixed-size stack
 //   expandable heap
 //   ...
+//   USTATS (read-only struct procstat slots of p's namespace)
 //   TRAPFRAME (p->trapframe, used by the trampoline)
 //   TRAMPOLINE (the same page as in the kernel)
 #define TRAPFRAME (TRAMPOLINE - PGSIZE)
+#define USTATS (TRAPFRAME - PGSIZE)
+
+// the upper half of a process's kernel page table maps its
+// user memory again, so user address va is also at UALIAS+va
+// in the kernel; see copyout().
+#define UALIAS 0xFFFFFFC000000000L
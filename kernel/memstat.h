@@ -0,0 +1,12 @@
+// Physical memory occupancy, as reported by the memstat
+// system call.
+#define NORDER 11          // block sizes 2^0 .. 2^(NORDER-1) pages
+
+struct memstat {
+  uint64 total;            // pages managed by the allocator
+  uint64 free;             // pages free in the buddy lists
+  uint64 cached;           // free pages held in per-cpu caches
+  uint64 pagecache;        // pages in the shared text page cache
+  uint64 zeroed;           // pre-zeroed pages held for kalloc_zeroed()
+  uint64 nblock[NORDER];   // free blocks of each order
+};
@@ -0,0 +1,11 @@
+// mmap() protection bits
+#define PROT_READ   0x1
+#define PROT_WRITE  0x2
+#define PROT_EXEC   0x4
+
+// mmap() flags
+#define MAP_SHARED     0x01   // writes go to the file or other processes
+#define MAP_PRIVATE    0x02   // writes stay in this process
+#define MAP_ANONYMOUS  0x20   // zero-filled, no file
+
+#define MAP_FAILED  ((void*)-1)
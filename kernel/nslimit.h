@@ -0,0 +1,12 @@
+// Resources a namespace can limit with setnslimit(). A process,
+// page or file counts against its namespace and every one that
+// encloses it, so a limit also caps the namespaces nested in it.
+#define NSLIM_PROC   0   // processes
+#define NSLIM_PAGES  1   // resident user pages
+#define NSLIM_FILES  2   // open files
+
+// What nsusage() reports. Needs param.h for NSLIM.
+struct nsusage {
+  int used[NSLIM];
+  int limit[NSLIM];   // 0 for no limit
+};
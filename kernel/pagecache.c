@@ -0,0 +1,163 @@
+// Cache of read-only file pages shared between processes.
+//
+// Non-writable vma pages (program text and read-only data)
+// are the same in every process running a binary, so
+// vmapage() maps them from here instead of reading a private
+// copy. An entry is keyed by the file and the offset and length
+// of the file data in the page; the rest of the page is zero.
+//
+// The cache holds one kalloc() reference to each page and every
+// mapping holds another, so a page stays valid for the processes
+// using it after its entry is dropped. Entries are dropped when
+// the file is written or truncated, and when the cache is full,
+// entries that no process maps are evicted.
+//
+// All pages of one file hash to the same chain, so that
+// pcinval() only looks at one chain. Entries are filled and
+// invalidated with the inode locked, so a fill can't race with
+// a write to the file.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "slab.h"
+#include "defs.h"
+
+#define NPCHASH 64
+
+struct pcentry {
+  struct pcentry *next;
+  uint dev;
+  uint inum;
+  uint off;
+  uint len;
+  char *pa;
+};
+
+struct {
+  struct spinlock lock;
+  struct pcentry *hash[NPCHASH];
+  struct kmem_cache cache;
+  int n;
+} pcache;
+
+void
+pcinit(void)
+{
+  initlock(&pcache.lock, "pcache");
+  kmem_cache_init(&pcache.cache, "pcentry", sizeof(struct pcentry));
+}
+
+static struct pcentry**
+pchash(uint dev, uint inum)
+{
+  return &pcache.hash[(dev * 31 + inum) % NPCHASH];
+}
+
+// drop an entry that no process maps, to make room.
+// caller holds pcache.lock.
+static int
+pcevict(void)
+{
+  struct pcentry **pp, *e;
+
+  for(int i = 0; i < NPCHASH; i++){
+    for(pp = &pcache.hash[i]; (e = *pp) != 0; pp = &e->next){
+      if(krefcnt(e->pa) == 1){
+        *pp = e->next;
+        kfree(e->pa);
+        kmem_cache_free(&pcache.cache, e);
+        pcache.n--;
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+// Return a page holding len bytes of ip at off followed by
+// zeroes, with a reference for the caller to map or kfree().
+// Returns 0 if out of memory or the file can't be read.
+char*
+pcget(struct inode *ip, uint off, uint len)
+{
+  struct pcentry *e, **h;
+  char *mem;
+
+  ilock(ip);
+  h = pchash(ip->dev, ip->inum);
+  acquire(&pcache.lock);
+  for(e = *h; e; e = e->next){
+    if(e->dev == ip->dev && e->inum == ip->inum && e->off == off && e->len == len){
+      kdup(e->pa);
+      release(&pcache.lock);
+      iunlock(ip);
+      return e->pa;
+    }
+  }
+  release(&pcache.lock);
+
+  if((mem = kalloc_zeroed()) == 0){
+    iunlock(ip);
+    return 0;
+  }
+  // past the end of the file reads as zeroes.
+  if(readi(ip, 0, (uint64)mem, off, len) < 0){
+    iunlock(ip);
+    kfree(mem);
+    return 0;
+  }
+
+  // add it, unless the cache is full of pages in use;
+  // then the caller just gets a private copy.
+  acquire(&pcache.lock);
+  if((pcache.n < NPAGECACHE || pcevict()) &&
+     (e = kmem_cache_alloc(&pcache.cache)) != 0){
+    e->dev = ip->dev;
+    e->inum = ip->inum;
+    e->off = off;
+    e->len = len;
+    e->pa = mem;
+    e->next = *h;
+    *h = e;
+    pcache.n++;
+    kdup(mem);
+  }
+  release(&pcache.lock);
+  iunlock(ip);
+  return mem;
+}
+
+// Drop the cached pages of ip, which is about to change.
+// Caller holds ip->lock.
+void
+pcinval(struct inode *ip)
+{
+  struct pcentry **pp, *e;
+
+  acquire(&pcache.lock);
+  pp = pchash(ip->dev, ip->inum);
+  while((e = *pp) != 0){
+    if(e->dev == ip->dev && e->inum == ip->inum){
+      *pp = e->next;
+      kfree(e->pa);
+      kmem_cache_free(&pcache.cache, e);
+      pcache.n--;
+    } else {
+      pp = &e->next;
+    }
+  }
+  release(&pcache.lock);
+}
+
+// Number of pages in the cache.
+int
+pcpages(void)
+{
+  return pcache.n;
+}
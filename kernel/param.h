@@ -1,8 +1,13 @@
 #define NPROC        64  // maximum number of processes
 #define NCPU          8  // maximum number of CPUs
+#define NPRIO         4  // scheduler priority levels, 0 runs first
+#define BOOSTTICKS   30  // ticks between lifting everyone to their top level
 #define NOFILE       16  // open files per process
-#define NFILE       100  // open files per system
-#define NINODE       50  // maximum number of active i-nodes
+#define NVMA         16  // file-backed regions per process
+#define NPAGECACHE  256  // pages in the shared text page cache
+#define USERMEGA      1  // back large anonymous user memory with megapages
+#define NZEROPAGES  128  // pre-zeroed pages idle harts keep for kalloc_zeroed()
+#define KJUNK         0  // fill pages with junk in kalloc()/kfree(), for debugging
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
@@ -13,5 +18,7 @@
 #define MAXPATH      128   // maximum file path name
 
 
-#define MAXDEPTH     8     // max depth ex 7
-#define NUMNS  64  // max number of namespaces 
\ No newline at end of file
+#define NSWEIGHT     100   // default cpu weight of a namespace
+#define NSMAXWEIGHT  10000 // largest weight setnsweight() accepts
+#define NSLIM        3     // resources a namespace can limit; see nslimit.h
+#define NNSEVENT     16    // recent exits a namespace remembers for wait_ns()
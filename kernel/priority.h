@@ -0,0 +1,4 @@
+// Targets of the setpriority system call. Priorities are
+// levels 0 (runs first) to NPRIO-1.
+#define PRIO_PROCESS 0   // the process who, 0 for the caller
+#define PRIO_NS      1   // the namespace of process who
@@ -7,19 +7,59 @@
 #include "defs.h"
 
 #include "process_info.h"
+#include "procstat.h"
+#include "priority.h"
+#include "nslimit.h"
+#include "slab.h"
+#include "waitns.h"
 
 struct cpu cpus[NCPU];
 
 struct proc proc[NPROC];
 
+// UNUSED processes, so allocproc() doesn't scan proc[].
+// proc[] itself stays a fixed array: each slot owns a
+// kernel stack mapping and a USTATS slot.
+struct {
+  struct spinlock lock;
+  struct proc *head;
+} procfree;
+
+// Sleeping processes, hashed by the channel they sleep on,
+// so that wakeup() only looks at processes that might match.
+#define NSLEEPQ 64
+struct sleepqueue {
+  struct spinlock lock;
+  struct proc *head;
+} sleepq[NSLEEPQ];
+
 struct proc *initproc;
 
 int nextpid = 1;
 struct spinlock pid_lock;
 struct spinlock ns_lock;
+struct spinlock sharelock;   // namespaces' cpu share counters
+
+// Index from global pids and (namespace, local pid) pairs
+// to processes, so lookups by pid don't scan proc[].
+#define NPIDHASH 256
+struct {
+  struct spinlock lock;
+  struct pidnode *head[NPIDHASH];
+} pidhash;
+
+// A process that nsmembers() found, with its pids at the time.
+// Whoever acts on p later takes p->lock and checks that p->pid
+// is still pid, in case p was freed and reused in between.
+struct nsmember {
+  struct proc *p;
+  int pid;      // global pid
+  int nspid;    // pid in the namespace walked
+};
 
 //namespaces
-struct namespace namespaces[NUMNS];
+struct kmem_cache nscache;
+struct kmem_cache pidcache;  // struct pidnode, for namespace pids
 struct namespace* initnamespace;
 int nextnamespace = 1;
 
@@ -56,13 +96,42 @@ void
 procinit(void)
 {
   struct proc *p;
+  struct cpu *c;
   
   initlock(&pid_lock, "nextpid");
   initlock(&wait_lock, "wait_lock");
-  for(p = proc; p < &proc[NPROC]; p++) {
+  initlock(&pidhash.lock, "pidhash");
+  initlock(&procfree.lock, "procfree");
+  procfree.head = 0;
+  for(c = cpus; c < &cpus[NCPU]; c++) {
+      initlock(&c->rq.lock, "runqueue");
+      c->rq.nsq = 0;
+      for(int k = 0; k < NPRIO; k++)
+        c->rq.nlevel[k] = 0;
+      c->rq.len = 0;
+  }
+  for(int i = 0; i < NSLEEPQ; i++) {
+      initlock(&sleepq[i].lock, "sleepq");
+      sleepq[i].head = 0;
+  }
+  if(NPROC * sizeof(struct procstat) > PGSIZE)
+    panic("procinit: procstat");
+  if(NPROC * sizeof(struct nsmember) > PGSIZE)
+    panic("procinit: nsmember");
+  for(p = &proc[NPROC-1]; p >= proc; p--) {
       initlock(&p->lock, "proc");
       p->state = UNUSED;
       p->kstack = KSTACK((int) (p - proc));
+      p->cpu = 0;
+      p->rq_next = 0;
+      p->sq_next = 0;
+      p->sq_pprev = 0;
+      p->free_next = procfree.head;
+      procfree.head = p;
+      p->parent = 0;
+      p->children = 0;
+      p->sibling = 0;
+      p->sibling_pprev = 0;
       p->init_ticks = 0;
       p->run_time = 0;               
       //p->last_run_start = 0;
@@ -74,31 +143,21 @@ procinit(void)
 
       //namespaces
       p->ns = 0;
-      for (int i = 0; i < MAXDEPTH; ++i) {
-          p->pids[i] = 0;
-      }
+      p->pidnodes = 0;
+      p->ns_next = 0;
+      p->ns_pprev = 0;
   }
 }
 
-// initialize the namespaces table.
+// initialize the namespace allocator.
 void
 namespaceinit(void) 
 {
   initlock(&ns_lock, "nextlocks");
   initlock(&wait_lock, "wait_lock");
-  struct namespace* ns;
-  for (ns = namespaces; ns < &namespaces[NUMNS]; ns++) {
-      initlock(&ns->lock, "namespace");
-      ns->parent = 0;
-      ns->head = 0;
-
-      ns->ns_id = 0;
-      ns->depth = 0;
-
-      ns->used = 0;
-      ns->next_ns_pid = 1;
-      ns->num_proc = 0;
-  }
+  initlock(&sharelock, "sharelock");
+  kmem_cache_init(&nscache, "namespace", sizeof(struct namespace));
+  kmem_cache_init(&pidcache, "pidnode", sizeof(struct pidnode));
 }
 
 // Must be called with interrupts disabled,
@@ -132,6 +191,359 @@ myproc(void)
   return p;
 }
 
+// Append p to the run queue of cpu id, at level p->prio in
+// the queue of its namespace.
+// Caller must hold p->lock.
+static void
+runqueue_push(struct proc *p, int id)
+{
+  struct runqueue *rq = &cpus[id].rq;
+  struct nsqueue *nq = &p->ns->rq[id];
+  int k = p->prio;
+
+  acquire(&rq->lock);
+  p->cpu = id;
+  p->rq_next = 0;
+  p->qprio = k;
+  p->qnice = p->nice;
+  if(nq->len++ == 0){
+    nq->next = rq->nsq;
+    rq->nsq = nq;
+  }
+  if(nq->tail[k])
+    nq->tail[k]->rq_next = p;
+  else
+    nq->head[k] = p;
+  nq->tail[k] = p;
+  rq->nlevel[k]++;
+  rq->len++;
+  release(&rq->lock);
+}
+
+// Ticks of cpu time, scaled by namespace weight, in vtime.
+#define VSCALE (1 << 20)
+
+// How far a namespace's vtime may fall behind its busiest
+// sibling's, so that one that sat idle doesn't get the cpu
+// to itself for long when it wakes up.
+#define VLAG (8 * (VSCALE / NSWEIGHT))
+
+// The vtime v of a child of ns, or of ns's own processes,
+// as it counts against the others: no further behind than VLAG.
+// nscharge() moves a lagging counter up to this before adding
+// to it, so the lag is used up once rather than every tick.
+static uint64
+vnow(uint64 v, struct namespace *ns)
+{
+  uint64 vmax = __atomic_load_n(&ns->vmax, __ATOMIC_RELAXED);
+
+  if(vmax > VLAG && v < vmax - VLAG)
+    return vmax - VLAG;
+  return v;
+}
+
+// Should p run before q? Where p's and q's branches of the
+// namespace tree part, the one with less vtime has had less
+// than its weight's share of the cpu and goes first. The
+// processes of a namespace itself count as one more branch
+// there, of weight NSWEIGHT. In the same namespace, the
+// higher scheduling level goes first.
+// The counters are read without sharelock; a stale one only
+// skews one choice.
+static int
+sharebefore(struct proc *p, struct proc *q)
+{
+  struct namespace *a = p->ns, *b = q->ns;
+  struct namespace *ca = 0, *cb = 0;
+  uint64 va, vb;
+
+  // climb to the common namespace, remembering
+  // the child of it that each side came from.
+  while(a->depth > b->depth){
+    ca = a;
+    a = a->parent;
+  }
+  while(b->depth > a->depth){
+    cb = b;
+    b = b->parent;
+  }
+  while(a != b){
+    ca = a;
+    a = a->parent;
+    cb = b;
+    b = b->parent;
+  }
+  if(ca != cb){
+    va = __atomic_load_n(ca ? &ca->vtime : &a->vself, __ATOMIC_RELAXED);
+    vb = __atomic_load_n(cb ? &cb->vtime : &a->vself, __ATOMIC_RELAXED);
+    va = vnow(va, a);
+    vb = vnow(vb, a);
+    if(va != vb)
+      return va < vb;
+  }
+  return p->qprio < q->qprio;
+}
+
+// Remove and return the process on cpu id's run queue that
+// should run first by sharebefore(), or 0 if the queue is
+// empty. Only the first process of the highest level of each
+// namespace's queue can be that one, so only those are compared.
+static struct proc*
+runqueue_pop(int id)
+{
+  struct runqueue *rq = &cpus[id].rq;
+  struct nsqueue *nq, **pq, **bestpq;
+  struct proc *p, *best;
+  int k, bestk;
+
+  // peek without the lock, so that idle harts looking for
+  // work don't bounce every queue's lock between caches.
+  if(__atomic_load_n(&rq->len, __ATOMIC_SEQ_CST) == 0)
+    return 0;
+
+  acquire(&rq->lock);
+  best = 0;
+  bestpq = 0;
+  bestk = 0;
+  for(pq = &rq->nsq; (nq = *pq) != 0; pq = &nq->next){
+    for(k = 0; nq->head[k] == 0; k++)
+      ;
+    p = nq->head[k];
+    if(best == 0 || sharebefore(p, best)){
+      best = p;
+      bestpq = pq;
+      bestk = k;
+    }
+  }
+  if((p = best) != 0){
+    nq = *bestpq;
+    if((nq->head[bestk] = p->rq_next) == 0)
+      nq->tail[bestk] = 0;
+    if(--nq->len == 0)
+      *bestpq = nq->next;
+    rq->nlevel[bestk]--;
+    rq->len--;
+    p->rq_next = 0;
+  }
+  release(&rq->lock);
+  return p;
+}
+
+// Is a process of a level above prio waiting for cpu id?
+static int
+runqueue_above(int id, int prio)
+{
+  struct runqueue *rq = &cpus[id].rq;
+
+  for(int k = 0; k < prio; k++)
+    if(__atomic_load_n(&rq->nlevel[k], __ATOMIC_RELAXED))
+      return 1;
+  return 0;
+}
+
+// Is anything queued on any cpu?
+static int
+anyrunnable(void)
+{
+  for(int i = 0; i < NCPU; i++)
+    if(__atomic_load_n(&cpus[i].rq.len, __ATOMIC_SEQ_CST))
+      return 1;
+  return 0;
+}
+
+// Work was just queued on cpu id. If that cpu waits in
+// wfi, or else if any other one does, send it a software
+// interrupt; it will find the work in pickproc().
+static void
+kickidle(int id)
+{
+  __sync_synchronize();
+  if(!__atomic_load_n(&cpus[id].idle, __ATOMIC_SEQ_CST)){
+    for(id = 0; id < NCPU; id++)
+      if(__atomic_load_n(&cpus[id].idle, __ATOMIC_SEQ_CST))
+        break;
+    if(id == NCPU)
+      return;
+  }
+  *(volatile uint32*)CLINT_MSIP(id) = 1;
+}
+
+// Wait in wfi until an interrupt arrives: a tick, a device,
+// or a kick from kickidle(). Interrupts stay off until then,
+// so that a kick sent after the last look at the run queues
+// is still pending when wfi starts.
+static void
+idle(struct cpu *c)
+{
+  intr_off();
+  c->idlestart = r_time();
+  __atomic_store_n(&c->idle, 1, __ATOMIC_SEQ_CST);
+  if(!anyrunnable()){
+    asm volatile("wfi");
+    c->wakeups++;
+  }
+  __atomic_store_n(&c->idle, 0, __ATOMIC_SEQ_CST);
+  c->idletime += r_time() - c->idlestart;
+}
+
+// bumped every BOOSTTICKS by schedboost().
+static uint boostepoch;
+
+// Apply a boost that happened since p last looked: back to its
+// top level with a fresh slice.
+// Caller must hold p->lock.
+static void
+applyboost(struct proc *p)
+{
+  uint epoch = __atomic_load_n(&boostepoch, __ATOMIC_SEQ_CST);
+
+  if(p->epoch != epoch){
+    p->epoch = epoch;
+    p->prio = p->nice;
+    p->slice = 0;
+  }
+}
+
+// Mark p RUNNABLE and queue it on cpu id, and if kick is set,
+// wake an idle cpu to run it. yield() doesn't kick: this cpu
+// is about to pick again, and another one would only steal p
+// while it is still in sched().
+// Caller must hold p->lock.
+static void
+makerunnable(struct proc *p, int id, int kick)
+{
+  // a boost happened while p ran or slept.
+  applyboost(p);
+  // setpriority() may have made p less nice.
+  if(p->prio < p->nice)
+    p->prio = p->nice;
+  p->state = RUNNABLE;
+  p->last_runnable = sys_uptime();
+  runqueue_push(p, id);
+  if(kick)
+    kickidle(id);
+}
+
+// Wake p from sleep. Giving up the cpu before its slice ran
+// out marks p as interactive, so it moves up a level.
+// Caller must hold p->lock.
+static void
+wakeproc(struct proc *p)
+{
+  if(p->prio > p->nice)
+    p->prio--;
+  p->slice = 0;
+  makerunnable(p, p->cpu, 1);
+}
+
+// Timer ticks a process may run at level prio before it
+// moves down a level.
+#define QUANTUM(prio) (1 << (prio))
+
+// Charge a tick to namespace ns and those it is in.
+static void
+nscharge(struct namespace *ns)
+{
+  acquire(&sharelock);
+  ns->vself = vnow(ns->vself, ns) + VSCALE / NSWEIGHT;
+  if(ns->vself > ns->vmax)
+    ns->vmax = ns->vself;
+  for(; ns; ns = ns->parent){
+    ns->ticks++;
+    if(ns->parent)
+      ns->vtime = vnow(ns->vtime, ns->parent);
+    ns->vtime += VSCALE / ns->weight;
+    if(ns->parent && ns->vtime > ns->parent->vmax)
+      ns->parent->vmax = ns->vtime;
+  }
+  release(&sharelock);
+}
+
+// Called on each timer interrupt while a process runs.
+// Charges the tick to its slice and namespaces, and gives
+// up the cpu if the slice is used up or a higher level is
+// waiting.
+void
+schedtick(void)
+{
+  struct proc *p = myproc();
+  int preempt;
+
+  nscharge(p->ns);
+  acquire(&p->lock);
+  p->slice++;
+  preempt = p->slice >= QUANTUM(p->prio) || runqueue_above(cpuid(), p->prio);
+  release(&p->lock);
+  if(preempt)
+    yield();
+}
+
+// Lift every process back to its top level, so that ones
+// that sank under a steady load of interactive work still
+// get to run. Queued processes move to their top level in
+// the queue now, which only needs the run queue's lock; each
+// process resets its own prio and slice under p->lock when it
+// is next picked or queued (see applyboost()).
+// Called every BOOSTTICKS ticks.
+void
+schedboost(void)
+{
+  struct runqueue *rq;
+  struct nsqueue *nq;
+  struct proc *p, *next, *all, **tail;
+  int k;
+
+  __atomic_add_fetch(&boostepoch, 1, __ATOMIC_SEQ_CST);
+
+  for(struct cpu *c = cpus; c < &cpus[NCPU]; c++){
+    rq = &c->rq;
+    acquire(&rq->lock);
+    for(k = 0; k < NPRIO; k++)
+      rq->nlevel[k] = 0;
+    for(nq = rq->nsq; nq; nq = nq->next){
+      // take all levels out in order, then queue each
+      // process again at its new level.
+      all = 0;
+      tail = &all;
+      for(k = 0; k < NPRIO; k++){
+        *tail = nq->head[k];
+        if(nq->tail[k])
+          tail = &nq->tail[k]->rq_next;
+        nq->head[k] = nq->tail[k] = 0;
+      }
+      for(p = all; p; p = next){
+        next = p->rq_next;
+        p->qprio = p->qnice;
+        p->rq_next = 0;
+        if(nq->tail[p->qprio])
+          nq->tail[p->qprio]->rq_next = p;
+        else
+          nq->head[p->qprio] = p;
+        nq->tail[p->qprio] = p;
+        rq->nlevel[p->qprio]++;
+      }
+    }
+    release(&rq->lock);
+  }
+}
+
+
+// Choose the next process for cpu id: the head of its own
+// run queue, or else one stolen from another cpu's queue.
+static struct proc*
+pickproc(int id)
+{
+  struct proc *p;
+
+  if((p = runqueue_pop(id)) != 0)
+    return p;
+  for(int i = 1; i < NCPU; i++){
+    if((p = runqueue_pop((id + i) % NCPU)) != 0)
+      return p;
+  }
+  return 0;
+}
+
 int
 allocpid()
 {
@@ -145,6 +557,163 @@ allocpid()
   return pid;
 }
 
+static struct pidnode**
+pidhash_bucket(struct namespace *ns, int pid)
+{
+  uint64 h = (uint64)ns ^ ((uint64)ns >> 9) ^ pid;
+  return &pidhash.head[h % NPIDHASH];
+}
+
+static void
+pidhash_insert(struct pidnode *n, struct proc *p, struct namespace *ns, int pid)
+{
+  struct pidnode **b = pidhash_bucket(ns, pid);
+
+  n->proc = p;
+  n->ns = ns;
+  n->pid = pid;
+  n->next = *b;
+  *b = n;
+}
+
+static void
+pidhash_remove(struct pidnode *n)
+{
+  struct pidnode **pp;
+
+  for(pp = pidhash_bucket(n->ns, n->pid); *pp; pp = &(*pp)->next){
+    if(*pp == n){
+      *pp = n->next;
+      break;
+    }
+  }
+  n->next = 0;
+  n->proc = 0;
+}
+
+// Enter p's global pid and its pid in every namespace
+// it is visible from into the pid index.
+// Caller must hold p->lock.
+static void
+pidhash_add(struct proc *p)
+{
+  struct pidnode *n;
+
+  acquire(&pidhash.lock);
+  pidhash_insert(&p->gpidnode, p, 0, p->pid);
+  for(n = p->pidnodes; n != 0; n = n->outer)
+    pidhash_insert(n, p, n->ns, n->pid);
+  release(&pidhash.lock);
+}
+
+// Remove p's pids from the pid index.
+// Caller must hold p->lock.
+static void
+pidhash_del(struct proc *p)
+{
+  struct pidnode *n;
+
+  acquire(&pidhash.lock);
+  pidhash_remove(&p->gpidnode);
+  for(n = p->pidnodes; n != 0; n = n->outer)
+    pidhash_remove(n);
+  release(&pidhash.lock);
+}
+
+// p's pid in namespace ns, or 0 if p can't be seen from ns.
+// Caller must hold p->lock, or otherwise keep p from being freed.
+int
+nspid(struct proc *p, struct namespace *ns)
+{
+  struct pidnode *n;
+
+  for(n = p->pidnodes; n != 0; n = n->outer)
+    if(n->ns == ns)
+      return n->pid;
+  return 0;
+}
+
+// Look up the process whose pid in namespace ns is pid,
+// or whose global pid is pid if ns is 0.
+// Returns with p->lock held, or 0 if there is no such process.
+struct proc*
+findproc(struct namespace *ns, int pid)
+{
+  struct pidnode *n;
+  struct proc *p = 0;
+
+  acquire(&pidhash.lock);
+  for(n = *pidhash_bucket(ns, pid); n != 0; n = n->next){
+    if(n->ns == ns && n->pid == pid){
+      p = n->proc;
+      break;
+    }
+  }
+  release(&pidhash.lock);
+
+  if(p == 0)
+    return 0;
+
+  // p->lock can't be taken under pidhash.lock, so p may
+  // have been freed and reused in between; check again.
+  acquire(&p->lock);
+  if(p->state == UNUSED || p->ns == 0)
+    goto stale;
+  if(ns == 0 && p->pid != pid)
+    goto stale;
+  if(ns != 0 && nspid(p, ns) != pid)
+    goto stale;
+  return p;
+
+stale:
+  release(&p->lock);
+  return 0;
+}
+
+// Write slot p of the statistics page of a namespace.
+static void
+ps_publish_slot(struct procstat* st, struct proc *p, int pid)
+{
+  st->seq++;
+  __sync_synchronize();
+  st->pid = pid;
+  st->state = p->state;
+  st->run_time = p->run_time;
+  st->context_switches = p->context_switches;
+  st->waiting_time = p->waiting_time;
+  st->read_b = p->read_b;
+  st->write_b = p->write_b;
+  st->heap_pages = p->heap_pages;
+  st->prio = p->prio;
+  safestrcpy(st->name, p->name, sizeof(st->name));
+  __sync_synchronize();
+  st->seq++;
+}
+
+// Publish p's statistics in the USTATS page of its
+// namespace and of every enclosing namespace.
+// Caller must hold p->lock, which keeps writers of
+// p's slots from overlapping.
+void
+ps_publish(struct proc *p)
+{
+  struct pidnode *n;
+
+  for(n = p->pidnodes; n != 0; n = n->outer)
+    ps_publish_slot(&n->ns->stats[p - proc], p, n->pid);
+}
+
+// Clear p's slots when it is freed.
+// Caller must hold p->lock.
+static void
+ps_unpublish(struct proc *p)
+{
+  struct pidnode *n;
+
+  for(n = p->pidnodes; n != 0; n = n->outer)
+    ps_publish_slot(&n->ns->stats[p - proc], p, 0);
+}
+
 int
 allocnamespaceid() 
 {
@@ -158,26 +727,33 @@ allocnamespaceid()
   return namespace;
 }
 
-// Look in the process table for an UNUSED proc.
+// Take an UNUSED proc off the free list.
 // If found, initialize state required to run in the kernel,
 // and return with p->lock held.
-// If there are no free procs, or a memory allocation fails, return 0.
+// If there are no free procs, ns is at its process limit,
+// or a memory allocation fails, return 0.
 static struct proc*
 allocproc(struct namespace* ns)
 {
   struct proc *p;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
-    acquire(&p->lock);
-    if(p->state == UNUSED) {
-      goto found;
-    } else {
-      release(&p->lock);
-    }
+  // freeproc() gives this back once p->ns is set.
+  if(nsreserve(ns, NSLIM_PROC, 1) < 0)
+    return 0;
+  acquire(&procfree.lock);
+  if((p = procfree.head) != 0)
+    procfree.head = p->free_next;
+  release(&procfree.lock);
+  if(p == 0){
+    nsrelease(ns, NSLIM_PROC, 1);
+    return 0;
   }
-  return 0;
 
-found:
+  // freeproc() queues p before its caller releases p->lock.
+  acquire(&p->lock);
+  if(p->state != UNUSED)
+    panic("allocproc");
+
   p->pid = allocpid();
   p->state = USED;
   p->read_b = 0;
@@ -187,25 +763,54 @@ found:
   p->is_kernel = 0;
   p->kernel_time = 0;
   p->last_kernel_time = sys_uptime();
+  p->nice = p->prio = ns->prio;
+  p->slice = 0;
+  p->epoch = __atomic_load_n(&boostepoch, __ATOMIC_SEQ_CST);
+  memset(p->prio_run, 0, sizeof(p->prio_run));
+  memset(p->prio_wait, 0, sizeof(p->prio_wait));
 
 
   // namespaces
-  // assigns process id within the current namespace hierarchy
-  p->ns = ns;
-  struct namespace* curr_ns = ns;
-  for (int i = ns->depth; i >= 0; --i) {
+  // assigns process id within the current namespace hierarchy,
+  // one pid index entry per level, innermost first.
+  p->ns = nsdup(ns);
+  struct pidnode **tail = &p->pidnodes;
+  for (struct namespace* curr_ns = ns; curr_ns != 0; curr_ns = curr_ns->parent) {
+    struct pidnode *n = kmem_cache_alloc(&pidcache);
+    if (n == 0) {
+      *tail = 0;
+      freeproc(p);
+      release(&p->lock);
+      return 0;
+    }
     acquire(&curr_ns->lock);
-
-    p->pids[i] = curr_ns->next_ns_pid;
+    n->pid = curr_ns->next_ns_pid;
     curr_ns->next_ns_pid++;
-    curr_ns->num_proc++;
-
     release(&curr_ns->lock);
 
-
-    // move to the parent namespace to continue assigning pids up the hierarchy
-    curr_ns = curr_ns->parent;
+    n->ns = curr_ns;
+    n->next = 0;
+    n->proc = 0;
+    *tail = n;
+    tail = &n->outer;
   }
+  *tail = 0;
+  pidhash_add(p);
+  ps_publish(p);
+
+  // wait_ns() reports only exits from now on.
+  acquire(&ns->evlock);
+  p->evseq = ns->evseq;
+  release(&ns->evlock);
+
+  // list p in ns for nsmembers().
+  acquire(&ns->lock);
+  p->ns_next = ns->members;
+  if(ns->members)
+    ns->members->ns_pprev = &p->ns_next;
+  ns->members = p;
+  p->ns_pprev = &ns->members;
+  release(&ns->lock);
 
   // Allocate a trapframe page.
   if((p->trapframe = (struct trapframe *)kalloc()) == 0){
@@ -222,6 +827,13 @@ found:
     return 0;
   }
 
+  // The page table p runs on in the kernel.
+  if((p->kpagetable = kvmproc()) == 0){
+    freeproc(p);
+    release(&p->lock);
+    return 0;
+  }
+
   // Set up new context to start executing at forkret,
   // which returns to user space.
   memset(&p->context, 0, sizeof(p->context));
@@ -231,37 +843,73 @@ found:
   return p;
 }
 
-// function searches for an available namespace, initializes it, and returns a pointer.
-// if all namespaces are occupied than 0.
+// Allocate a namespace with no parent, holding one reference
+// for the caller. Returns 0 if out of memory.
 struct namespace*
 allocnamespace(void) {
     struct namespace* ns;
-    // iterate through the global namespaces
-    for (ns = namespaces; ns < &namespaces[NUMNS]; ns++) {
-        acquire(&ns->lock);
-
-        // if this namespace is currently unused
-        if (ns->used == 0) {
-            // Initialize the namespace's properties
-            ns->ns_id = allocnamespaceid(); // a new unique namespace id
-            ns->head = 0;                   
-            ns->parent = 0;                 
-            ns->used = 1;                  
-            ns->num_proc = 0;               
-            ns->depth = 0;                  
-            ns->next_ns_pid = 1;            
-
-            release(&ns->lock);
-            // return the initialized namespace
-            return ns;
-        } else {
-            // if this namespace is already used
-            release(&ns->lock);
-        }
+
+    if ((ns = kmem_cache_alloc(&nscache)) == 0)
+        return 0;
+    // the statistics page that processes in ns map at USTATS
+    if ((ns->stats = (struct procstat*)kalloc_zeroed()) == 0) {
+        kmem_cache_free(&nscache, ns);
+        return 0;
     }
 
-    // if all in use
-    return 0;
+    // Initialize the namespace's properties
+    initlock(&ns->lock, "namespace");
+    initlock(&ns->evlock, "nsevents");
+    ns->evseq = 0;
+    ns->ns_id = allocnamespaceid(); // a new unique namespace id
+    ns->head = 0;
+    ns->parent = 0;
+    ns->members = 0;
+    ns->children = 0;
+    ns->sibling = 0;
+    ns->sibling_pprev = 0;
+    ns->ref = 1;
+    ns->depth = 0;
+    ns->next_ns_pid = 1;
+    ns->prio = 0;
+    memset(ns->usage, 0, sizeof(ns->usage));
+    memset(ns->limit, 0, sizeof(ns->limit));
+    ns->weight = NSWEIGHT;
+    ns->ticks = 0;
+    ns->vtime = ns->vself = ns->vmax = 0;
+    return ns;
+}
+
+// Take another reference to ns.
+struct namespace*
+nsdup(struct namespace *ns)
+{
+  __atomic_add_fetch(&ns->ref, 1, __ATOMIC_RELAXED);
+  return ns;
+}
+
+// Drop a reference to ns. The last one frees it, which
+// drops its reference to its parent in turn.
+void
+nsput(struct namespace *ns)
+{
+  struct namespace *parent;
+
+  while(ns != 0 && __atomic_sub_fetch(&ns->ref, 1, __ATOMIC_ACQ_REL) == 0){
+    parent = ns->parent;
+    // nsmembers() may still be looking at ns, but it
+    // holds parent->lock while it does.
+    if(parent){
+      acquire(&parent->lock);
+      *ns->sibling_pprev = ns->sibling;
+      if(ns->sibling)
+        ns->sibling->sibling_pprev = ns->sibling_pprev;
+      release(&parent->lock);
+    }
+    kfree((void*)ns->stats);
+    kmem_cache_free(&nscache, ns);
+    ns = parent;
+  }
 }
 
 
@@ -271,15 +919,41 @@ allocnamespace(void) {
 static void
 freeproc(struct proc *p)
 {
+  struct pidnode *n, *next;
+
+  // nsmembers() reads p->pid and p->pidnodes holding only
+  // namespace locks, so p leaves ns->members before they go.
+  if(p->ns != 0){
+    acquire(&p->ns->lock);
+    if(p->ns_pprev){
+      *p->ns_pprev = p->ns_next;
+      if(p->ns_next)
+        p->ns_next->ns_pprev = p->ns_pprev;
+    }
+    release(&p->ns->lock);
+    p->ns_next = 0;
+    p->ns_pprev = 0;
+  }
+
   if(p->trapframe)
     kfree((void*)p->trapframe);
   p->trapframe = 0;
+  if(p->pid != 0 && p->ns != 0){
+    pidhash_del(p);
+    ps_unpublish(p);
+  }
   if(p->pagetable)
     proc_freepagetable(p->pagetable, p->sz);
   p->pagetable = 0;
+  if(p->kpagetable)
+    kfree((void*)p->kpagetable);
+  p->kpagetable = 0;
   p->sz = 0;
   p->pid = 0;
   p->parent = 0;
+  p->children = 0;
+  p->sibling = 0;
+  p->sibling_pprev = 0;
   p->name[0] = 0;
   p->chan = 0;
   p->killed = 0;
@@ -297,10 +971,23 @@ freeproc(struct proc *p)
   }
 
   // namespace
-  p->ns = 0;
-  for (int i = 0; i < MAXDEPTH; ++i) {
-    p->pids[i] = 0;
+  for(n = p->pidnodes; n != 0; n = next){
+    next = n->outer;
+    kmem_cache_free(&pidcache, n);
   }
+  p->pidnodes = 0;
+  if(p->ns != 0){
+    nsrelease(p->ns, NSLIM_PAGES, p->heap_pages);
+    nsrelease(p->ns, NSLIM_PROC, 1);
+    nsput(p->ns);
+  }
+  p->heap_pages = 0;
+  p->ns = 0;
+
+  acquire(&procfree.lock);
+  p->free_next = procfree.head;
+  procfree.head = p;
+  release(&procfree.lock);
 }
 
 // Create a user page table for a given process, with no user memory,
@@ -334,6 +1021,16 @@ proc_pagetable(struct proc *p)
     return 0;
   }
 
+  // map the namespace's statistics page below the trapframe,
+  // readable by the user.
+  if(mappages(pagetable, USTATS, PGSIZE,
+              (uint64)(p->ns->stats), PTE_R | PTE_U) < 0){
+    uvmunmap(pagetable, TRAPFRAME, 1, 0);
+    uvmunmap(pagetable, TRAMPOLINE, 1, 0);
+    uvmfree(pagetable, 0);
+    return 0;
+  }
+
   return pagetable;
 }
 
@@ -344,6 +1041,7 @@ proc_freepagetable(pagetable_t pagetable, uint64 sz)
 {
   uvmunmap(pagetable, TRAMPOLINE, 1, 0);
   uvmunmap(pagetable, TRAPFRAME, 1, 0);
+  uvmunmap(pagetable, USTATS, 1, 0);
   uvmfree(pagetable, sz);
 }
 
@@ -384,22 +1082,45 @@ userinit(void)
   safestrcpy(p->name, "initcode", sizeof(p->name));
   p->cwd = namei("/");
 
-  p->state = RUNNABLE;
   p->init_ticks = sys_uptime();
-  p->last_runnable = sys_uptime();
+  ps_publish(p);
+  makerunnable(p, cpuid(), 1);
 
 
   // namespace
   acquire(&ns->lock);
   ns->head = initproc;
-  ns->num_proc = 1;
   release(&ns->lock);
 
-  p->ns = initnamespace;
-
   release(&p->lock);
 }
 
+// Make child a child of parent.
+// Caller must hold wait_lock.
+static void
+addchild(struct proc *parent, struct proc *child)
+{
+  child->parent = parent;
+  child->sibling = parent->children;
+  if(parent->children)
+    parent->children->sibling_pprev = &child->sibling;
+  parent->children = child;
+  child->sibling_pprev = &parent->children;
+}
+
+// Remove p from its parent's list of children.
+// Caller must hold wait_lock.
+static void
+removechild(struct proc *p)
+{
+  *p->sibling_pprev = p->sibling;
+  if(p->sibling)
+    p->sibling->sibling_pprev = p->sibling_pprev;
+  p->parent = 0;
+  p->sibling = 0;
+  p->sibling_pprev = 0;
+}
+
 // Grow or shrink user memory by n bytes.
 // Return 0 on copy_res, -1 on failure.
 int
@@ -410,11 +1131,14 @@ growproc(int n)
 
   sz = p->sz;
   if(n > 0){
-    if((sz = uvmalloc(p->pagetable, sz, sz + n, PTE_W)) == 0) {
+    // pages are allocated on first touch, by uvmlazy().
+    if(sz + n > USTATS || vmaoverlap(p->vmas, PGROUNDUP(sz), PGROUNDUP(sz + n)))
       return -1;
-    }
+    sz += n;
   } else if(n < 0){
-    sz = uvmdealloc(p->pagetable, sz, sz + n);
+    // a megapage cut in two needs a page-table page.
+    if((sz = uvmdealloc(p->pagetable, sz, sz + n)) == p->sz)
+      return -1;
   }
   p->sz = sz;
   return 0;
@@ -434,13 +1158,32 @@ fork(void)
     return -1;
   }
 
-  // Copy user memory from parent to child.
+  // the child maps the same pages, and they count
+  // against its namespace again.
+  if(nsreserve(np->ns, NSLIM_PAGES, p->heap_pages) < 0){
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+  np->heap_pages = p->heap_pages;
+
+  // Copy user memory from parent to child. Set np->sz as
+  // soon as there is heap to free if vmacopy() fails.
   if(uvmcopy(p->pagetable, np->pagetable, p->sz) < 0){
     freeproc(np);
     release(&np->lock);
     return -1;
   }
   np->sz = p->sz;
+  if(vmacopy(p->pagetable, np->pagetable, p->vmas) < 0){
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+
+  // a child is no nicer than its parent.
+  if(p->nice > np->nice)
+    np->nice = np->prio = p->nice;
 
   // copy saved user registers.
   *(np->trapframe) = *(p->trapframe);
@@ -453,20 +1196,19 @@ fork(void)
     if(p->ofile[i])
       np->ofile[i] = filedup(p->ofile[i]);
   np->cwd = idup(p->cwd);
+  vmadup(np->vmas, p->vmas);
 
   safestrcpy(np->name, p->name, sizeof(p->name));
 
-  pid = np->pids[p->ns->depth];
+  pid = nspid(np, p->ns);
 
   release(&np->lock);
 
   acquire(&wait_lock);
-  np->parent = p;
+  addchild(p, np);
   release(&wait_lock);
 
   acquire(&np->lock);
-  np->state = RUNNABLE;
-  np->last_runnable = sys_uptime();
   np->init_ticks = sys_uptime();
   np->run_time = 0;
   //np->last_run_start = 0;
@@ -474,6 +1216,8 @@ fork(void)
   np->kernel_time = 0;
   //np->user_time = 0;
   np->waiting_time = 0;
+  ps_publish(np);
+  makerunnable(np, cpuid(), 1);
 
   release(&np->lock);
 
@@ -492,25 +1236,58 @@ clone(void) {
     // Allocate namespace
     struct namespace* ns = allocnamespace();
     if (ns == 0) { return -1; }
-    ns->parent = p->ns;
-    if (p->ns->depth + 1 >= MAXDEPTH) { return -1; }
+    ns->parent = nsdup(p->ns);
     ns->depth = p->ns->depth + 1;
-
-    // Allocate process.
-    if ((np = allocproc(ns)) == 0) {
+    acquire(&p->ns->lock);
+    ns->sibling = p->ns->children;
+    if (ns->sibling)
+        ns->sibling->sibling_pprev = &ns->sibling;
+    p->ns->children = ns;
+    ns->sibling_pprev = &p->ns->children;
+    release(&p->ns->lock);
+    ns->prio = p->ns->prio;
+    for (i = 0; i < NSLIM; i++)
+        ns->limit[i] = __atomic_load_n(&p->ns->limit[i], __ATOMIC_RELAXED);
+    // start level with the busiest sibling rather than
+    // catching up on ticks the others used before ns existed.
+    acquire(&sharelock);
+    ns->vtime = p->ns->vmax;
+    release(&sharelock);
+
+    // Allocate process. From here on np keeps ns alive,
+    // and if np fails to start, ns goes with it.
+    np = allocproc(ns);
+    nsput(ns);
+    if (np == 0) {
         return -1;
     }
     
     // Assign np as ns head
     ns->head = np;
 
-    // Copy user memory from parent to child.
+    if (nsreserve(ns, NSLIM_PAGES, p->heap_pages) < 0) {
+        freeproc(np);
+        release(&np->lock);
+        return -1;
+    }
+    np->heap_pages = p->heap_pages;
+
+    // Copy user memory from parent to child; see fork().
     if (uvmcopy(p->pagetable, np->pagetable, p->sz) < 0) {
         freeproc(np);
         release(&np->lock);
         return -1;
     }
     np->sz = p->sz;
+    if (vmacopy(p->pagetable, np->pagetable, p->vmas) < 0) {
+        freeproc(np);
+        release(&np->lock);
+        return -1;
+    }
+
+    // a child is no nicer than its parent.
+    if (p->nice > np->nice)
+        np->nice = np->prio = p->nice;
 
     // copy saved user registers.
     *(np->trapframe) = *(p->trapframe);
@@ -523,20 +1300,19 @@ clone(void) {
         if (p->ofile[i])
             np->ofile[i] = filedup(p->ofile[i]);
     np->cwd = idup(p->cwd);
+    vmadup(np->vmas, p->vmas);
 
     safestrcpy(np->name, p->name, sizeof(p->name));
 
-    pid = np->pids[p->ns->depth];
+    pid = nspid(np, p->ns);
 
     release(&np->lock);
 
     acquire(&wait_lock);
-    np->parent = p;
+    addchild(p, np);
     release(&wait_lock);
 
     acquire(&np->lock);
-    np->state = RUNNABLE;
-    np->last_runnable = sys_uptime();
     np->init_ticks = sys_uptime();
     np->run_time = 0;
     //np->last_run_start = 0;
@@ -544,22 +1320,36 @@ clone(void) {
     np->kernel_time = 0;
     //np->user_time = 0;
     np->waiting_time = 0;
+    ps_publish(np);
+    makerunnable(np, cpuid(), 1);
     release(&np->lock);
 
     return pid;
 }
 
-// comparing two namespaces and going to parent of ns
+// The parent's pid, if it is in the caller's namespace, else 0.
 int
-compare_ns(struct namespace* ns1, struct namespace* ns2) {
-  struct namespace* ns = ns1;
-  while (ns != 0) {
-      if (ns == ns2) { return 1; }
-      ns = ns->parent;
-  }
-  return 0;
+getppid(void)
+{
+  struct proc *p = myproc();
+  int ppid = 0;
+
+  // wait_lock keeps the parent from being freed.
+  acquire(&wait_lock);
+  if (p->parent && p->ns == p->parent->ns)   // if same ns
+    ppid = nspid(p->parent, p->ns);          // ppid in this ns
+  release(&wait_lock);
+  return ppid;
 }
 
+// The process that adopts orphans from ns: its init process,
+// or if that has exited, the init process of the nearest
+// enclosing namespace that still has one.
+// This walk stands in for a per-namespace list of reaper
+// candidates. It runs once per exit, not once per orphan, and
+// only passes namespaces whose init has already exited, while
+// a list kept in each namespace would have to be fixed up in
+// every namespace nested below one whose init exits.
 struct proc*
 get_ns_head(struct namespace* ns) {
     struct namespace* curr_ns = ns;
@@ -571,19 +1361,65 @@ get_ns_head(struct namespace* ns) {
     return p;
 }
 
-// Pass p's abandoned children to init.
+// Pass p's abandoned children to the init process of
+// the nearest namespace that still has one.
 // Caller must hold wait_lock.
 void
 reparent(struct proc *p)
 {
-  struct proc *pp;
+  struct proc *pp, *reaper, *last;
 
-  for(pp = proc; pp < &proc[NPROC]; pp++){
-    if(pp->parent == p){
-      struct proc* new_parent = get_ns_head(pp->ns);
-      pp->parent = new_parent;
-      wakeup(new_parent);
-    }
+  // p is on its way out, so it can no longer adopt
+  // orphans in its own namespace.
+  acquire(&p->ns->lock);
+  if(p->ns->head == p)
+    p->ns->head = 0;
+  release(&p->ns->lock);
+
+  if(p->children == 0)
+    return;
+
+  // one walk up the namespace tree serves every orphan.
+  reaper = get_ns_head(p->ns);
+
+  last = 0;
+  for(pp = p->children; pp; pp = pp->sibling){
+    pp->parent = reaper;
+    last = pp;
+  }
+
+  // splice the whole list onto the front of reaper's children.
+  last->sibling = reaper->children;
+  if(reaper->children)
+    reaper->children->sibling_pprev = &last->sibling;
+  reaper->children = p->children;
+  reaper->children->sibling_pprev = &reaper->children;
+  p->children = 0;
+
+  wakeup(reaper);
+}
+
+// Tell wait_ns() callers in p's namespace and every enclosing
+// one that p exited, each under its pid there. A namespace
+// keeps only the last NNSEVENT exits; a waiter that falls
+// further behind misses the older ones.
+// Caller must hold wait_lock, so that p is a zombie by the
+// time a waiter can try to reap it.
+static void
+nsexitevent(struct proc *p, int status)
+{
+  struct pidnode *n;
+  struct nsevent *ev;
+
+  for(n = p->pidnodes; n != 0; n = n->outer){
+    acquire(&n->ns->evlock);
+    ev = &n->ns->events[n->ns->evseq % NNSEVENT];
+    ev->pid = p->pid;
+    ev->nspid = n->pid;
+    ev->status = status;
+    n->ns->evseq++;
+    release(&n->ns->evlock);
+    wakeup(&n->ns->evseq);
   }
 }
 
@@ -607,6 +1443,8 @@ exit(int status)
     }
   }
 
+  vmaput(p->pagetable, p->vmas);
+
   begin_op();
   iput(p->cwd);
   end_op();
@@ -619,12 +1457,16 @@ exit(int status)
 
   // Parent might be sleeping in wait().
   wakeup(p->parent);
+
+  // Supervisors might be sleeping in wait_ns().
+  nsexitevent(p, status);
   
   acquire(&p->lock);
   
 
   p->xstate = status;
   p->run_time += sys_uptime() - p->last_run_start;
+  p->prio_run[p->prio] += sys_uptime() - p->last_run_start;
   
   if(p->is_kernel){
     p->kernel_time += sys_uptime() - p->last_kernel_time;
@@ -648,33 +1490,36 @@ wait(uint64 addr)
   int havekids, pid;
   struct proc *p = myproc();
 
+  // the status is copied out with locks held.
+  if(addr != 0)
+    uvmprefault(p->pagetable, addr, sizeof(int));
+
   acquire(&wait_lock);
 
   for(;;){
-    // Scan through table looking for exited children.
+    // Scan through our children looking for exited ones.
     havekids = 0;
-    for(pp = proc; pp < &proc[NPROC]; pp++){
-      if(pp->parent == p){
-        // make sure the child isn't still in exit() or swtch().
-        acquire(&pp->lock);
-
-        havekids = 1;
-        if(pp->state == ZOMBIE){
-          // Found one.
-          pid = pp->pid;
-          if(addr != 0 && copyout(p->pagetable, addr, (char *)&pp->xstate,
-                                  sizeof(pp->xstate)) < 0) {
-            release(&pp->lock);
-            release(&wait_lock);
-            return -1;
-          }
-          freeproc(pp);
+    for(pp = p->children; pp; pp = pp->sibling){
+      // make sure the child isn't still in exit() or swtch().
+      acquire(&pp->lock);
+
+      havekids = 1;
+      if(pp->state == ZOMBIE){
+        // Found one.
+        pid = pp->pid;
+        if(addr != 0 && copyout(p->pagetable, addr, (char *)&pp->xstate,
+                                sizeof(pp->xstate)) < 0) {
           release(&pp->lock);
           release(&wait_lock);
-          return pid;
+          return -1;
         }
+        removechild(pp);
+        freeproc(pp);
         release(&pp->lock);
+        release(&wait_lock);
+        return pid;
       }
+      release(&pp->lock);
     }
 
     // No point waiting if we don't have any children.
@@ -688,10 +1533,67 @@ wait(uint64 addr)
   }
 }
 
+// Wait for the next exit of a process in the caller's namespace
+// or one nested in it, and copy its pid in the caller's namespace
+// and its exit status to user addresses pidaddr and addr, if they
+// aren't 0. With WNS_NOHANG, report pid 0 rather than wait if
+// there is none. With WNS_REAP, also free the process if it is
+// a child of the caller, as wait() would; a namespace's first
+// process adopts its orphans, so it can reap them all.
+// Unlike wait(), other processes of the namespace see the same
+// exits. Returns 0, or -1 if killed or a copy fails.
+int
+wait_ns(int flags, uint64 addr, uint64 pidaddr)
+{
+  struct proc *pp, *p = myproc();
+  struct namespace *ns = p->ns;
+  struct nsevent ev;
+
+  acquire(&ns->evlock);
+  for(;;){
+    if(ns->evseq - p->evseq > NNSEVENT)
+      p->evseq = ns->evseq - NNSEVENT;
+    if(p->evseq != ns->evseq){
+      ev = ns->events[p->evseq % NNSEVENT];
+      p->evseq++;
+      break;
+    }
+    if(flags & WNS_NOHANG){
+      memset(&ev, 0, sizeof(ev));
+      break;
+    }
+    if(killed(p)){
+      release(&ns->evlock);
+      return -1;
+    }
+    sleep(&ns->evseq, &ns->evlock);
+  }
+  release(&ns->evlock);
+
+  if(ev.pid != 0 && (flags & WNS_REAP)){
+    acquire(&wait_lock);
+    if((pp = findproc(0, ev.pid)) != 0){
+      if(pp->parent == p && pp->state == ZOMBIE){
+        removechild(pp);
+        freeproc(pp);
+      }
+      release(&pp->lock);
+    }
+    release(&wait_lock);
+  }
+
+  if(addr != 0 && copyout(p->pagetable, addr, (char*)&ev.status, sizeof(ev.status)) < 0)
+    return -1;
+  if(pidaddr != 0 && copyout(p->pagetable, pidaddr, (char*)&ev.nspid, sizeof(ev.nspid)) < 0)
+    return -1;
+  return 0;
+}
+
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
-//  - choose a process to run.
+//  - take a process from this CPU's run queue,
+//    or steal one from another CPU's queue.
 //  - swtch to start running that process.
 //  - eventually that process transfers control
 //    via swtch back to the scheduler.
@@ -700,34 +1602,54 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  int id = c - cpus;
   
   c->proc = 0;
+  c->online = 1;
   for(;;){
     // Avoid deadlock by ensuring that devices can interrupt.
     intr_on();
 
-    for(p = proc; p < &proc[NPROC]; p++) {
-      acquire(&p->lock);
-      if(p->state == RUNNABLE) {
-        // Switch to chosen process.  It is the process's job
-        // to release its lock and then reacquire it
-        // before jumping back to us.
-        p->state = RUNNING;
-        p->waiting_time += sys_uptime() - p->last_runnable;
-        p->last_run_start = sys_uptime();
-        if(p->is_kernel){
-          p->last_kernel_time = sys_uptime();
-        }
-        c->proc = p;
-        swtch(&c->context, &p->context);
-        p->context_switches++;
+    // nothing to run: clear a page for kalloc_zeroed(),
+    // or if the pool is full, sleep until there is work.
+    if((p = pickproc(id)) == 0){
+      if(!kzerofill())
+        idle(c);
+      continue;
+    }
 
-        // Process is done running for now.
-        // It should have changed its p->state before coming back.
-        c->proc = 0;
+    acquire(&p->lock);
+    if(p->state == RUNNABLE) {
+      // Switch to chosen process.  It is the process's job
+      // to release its lock and then reacquire it
+      // before jumping back to us.
+      applyboost(p);
+      p->state = RUNNING;
+      p->cpu = id;
+      p->waiting_time += sys_uptime() - p->last_runnable;
+      p->prio_wait[p->prio] += sys_uptime() - p->last_runnable;
+      p->last_run_start = sys_uptime();
+      if(p->is_kernel){
+        p->last_kernel_time = sys_uptime();
       }
-      release(&p->lock);
+      c->proc = p;
+      ps_publish(p);
+      // p's kernel page table also reaches its user memory.
+      w_satp(MAKE_SATP(p->kpagetable));
+      sfence_vma();
+      swtch(&c->context, &p->context);
+      kvminithart();
+      p->context_switches++;
+
+      // covers the run_time that yield(), sleep()
+      // and exit() charged on the way out.
+      ps_publish(p);
+
+      // Process is done running for now.
+      // It should have changed its p->state before coming back.
+      c->proc = 0;
     }
+    release(&p->lock);
   }
 }
 
@@ -765,12 +1687,18 @@ yield(void)
 {
   struct proc *p = myproc();
   acquire(&p->lock);
-  p->state = RUNNABLE;
   p->run_time += sys_uptime() - p->last_run_start;
+  p->prio_run[p->prio] += sys_uptime() - p->last_run_start;
   if(p->is_kernel){
     p->kernel_time += sys_uptime() - p->last_kernel_time;
   }
-  p->last_runnable = sys_uptime();
+  // a process that uses its whole slice moves down a level.
+  if(p->slice >= QUANTUM(p->prio)){
+    if(p->prio < NPRIO-1)
+      p->prio++;
+    p->slice = 0;
+  }
+  makerunnable(p, cpuid(), 0);
   sched();
   release(&p->lock);
 }
@@ -796,27 +1724,64 @@ forkret(void)
   usertrapret();
 }
 
+// Return the sleep queue bucket for chan.
+static struct sleepqueue*
+sleepq_of(void *chan)
+{
+  uint64 h = (uint64)chan;
+  return &sleepq[((h >> 2) ^ (h >> 10)) % NSLEEPQ];
+}
+
+// Add p to the front of sq.
+// Caller must hold sq->lock.
+static void
+sleepq_insert(struct sleepqueue *sq, struct proc *p)
+{
+  p->sq_next = sq->head;
+  if(sq->head)
+    sq->head->sq_pprev = &p->sq_next;
+  sq->head = p;
+  p->sq_pprev = &sq->head;
+}
+
+// Unlink p from its sleep queue.
+// Caller must hold that queue's lock.
+static void
+sleepq_remove(struct proc *p)
+{
+  *p->sq_pprev = p->sq_next;
+  if(p->sq_next)
+    p->sq_next->sq_pprev = p->sq_pprev;
+  p->sq_next = 0;
+  p->sq_pprev = 0;
+}
+
 // Atomically release lock and sleep on chan.
 // Reacquires lock when awakened.
 void
 sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
+  struct sleepqueue *sq = sleepq_of(chan);
   
   // Must acquire p->lock in order to
   // change p->state and then call sched.
   // Once we hold p->lock, we can be
   // guaranteed that we won't miss any wakeup
-  // (wakeup locks p->lock),
+  // (wakeup locks the sleep queue and then p->lock),
   // so it's okay to release lk.
 
+  acquire(&sq->lock);
   acquire(&p->lock);  //DOC: sleeplock1
   release(lk);
 
   // Go to sleep.
   p->chan = chan;
+  sleepq_insert(sq, p);
+  release(&sq->lock);
 
   p->run_time += sys_uptime() - p->last_run_start;
+  p->prio_run[p->prio] += sys_uptime() - p->last_run_start;
 
   if(p->is_kernel){
     p->kernel_time += sys_uptime() - p->last_kernel_time;
@@ -827,9 +1792,20 @@ sleep(void *chan, struct spinlock *lk)
 
   // Tidy up.
   p->chan = 0;
+  release(&p->lock);
+
+  // wakeup() unlinks the processes it wakes, but kill() can't
+  // (it holds p->lock), so leave the queue ourselves if needed.
+  // only wakeup() clears sq_pprev behind our back, so seeing
+  // zero without the lock is safe.
+  if(p->sq_pprev){
+    acquire(&sq->lock);
+    if(p->sq_pprev)
+      sleepq_remove(p);
+    release(&sq->lock);
+  }
 
   // Reacquire original lock.
-  release(&p->lock);
   acquire(lk);
 }
 
@@ -838,21 +1814,229 @@ sleep(void *chan, struct spinlock *lk)
 void
 wakeup(void *chan)
 {
-  struct proc *p;
-
-  for(p = proc; p < &proc[NPROC]; p++) {
-    if(p != myproc()){
+  struct sleepqueue *sq = sleepq_of(chan);
+  struct proc *p, *next;
+  struct proc *me = myproc();
+
+  acquire(&sq->lock);
+  for(p = sq->head; p; p = next) {
+    next = p->sq_next;
+    if(p != me){
       acquire(&p->lock);
       if(p->state == SLEEPING && p->chan == chan) {
-        p->state = RUNNABLE;
-        p->last_runnable = sys_uptime();
+        sleepq_remove(p);
+        wakeproc(p);
       }
       release(&p->lock);
     }
   }
+  release(&sq->lock);
+}
+
+// Mark p killed, waking it if it sleeps.
+// Caller must hold p->lock.
+static void
+killproc(struct proc *p)
+{
+  p->killed = 1;
+  if(p->state == SLEEPING){
+    // Wake process from sleep().
+    wakeproc(p);
+  }
+}
+
+// Set the nice value of process who, a pid in the caller's
+// namespace or 0 for the caller: the highest level it may run
+// at. With PRIO_NS, set the least nice value of processes
+// created from now on in who's namespace instead.
+int
+setpriority(int which, int who, int prio)
+{
+  struct proc *p, *me = myproc();
+  struct namespace *ns;
+
+  if(prio < 0 || prio >= NPRIO)
+    return -1;
+  if(who == 0){
+    p = me;
+    acquire(&p->lock);
+  } else if((p = findproc(me->ns, who)) == 0){
+    return -1;
+  }
+
+  if(which == PRIO_PROCESS){
+    // takes effect the next time p is queued.
+    p->nice = prio;
+    release(&p->lock);
+    return 0;
+  }
+  if(which != PRIO_NS){
+    release(&p->lock);
+    return -1;
+  }
+  // p->lock keeps p, and so its namespace, from going away.
+  ns = p->ns;
+  acquire(&ns->lock);
+  ns->prio = prio;
+  release(&ns->lock);
+  release(&p->lock);
+  return 0;
+}
+
+// Set the cpu weight of the namespace of process who, a pid
+// in the caller's namespace. Sibling namespaces share the cpu
+// in proportion to their weights. A process can't change its
+// own namespace's weight, only those of namespaces in it.
+int
+setnsweight(int who, int weight)
+{
+  struct proc *p, *me = myproc();
+  struct namespace *ns;
+
+  if(weight < 1 || weight > NSMAXWEIGHT)
+    return -1;
+  if((p = findproc(me->ns, who)) == 0)
+    return -1;
+  ns = p->ns;
+  if(ns == me->ns){
+    release(&p->lock);
+    return -1;
+  }
+  acquire(&sharelock);
+  ns->weight = weight;
+  release(&sharelock);
+  release(&p->lock);
+  return 0;
+}
+
+// Give back n units of resource r that ns and the namespaces
+// enclosing it, up to but not including stop, were charged.
+static void
+nsuncharge(struct namespace *ns, struct namespace *stop, int r, int n)
+{
+  for(; ns != stop; ns = ns->parent)
+    __atomic_sub_fetch(&ns->usage[r], n, __ATOMIC_RELAXED);
+}
+
+// Charge n units of resource r (see nslimit.h) to namespace
+// ns and every one enclosing it. Returns -1, charging nothing,
+// if that would take any of them over its limit.
+// Two callers racing for the last units may both fail, but
+// together they never go over.
+int
+nsreserve(struct namespace *ns, int r, int n)
+{
+  struct namespace *s;
+  int used, limit;
+
+  for(s = ns; s; s = s->parent){
+    used = __atomic_add_fetch(&s->usage[r], n, __ATOMIC_RELAXED);
+    limit = __atomic_load_n(&s->limit[r], __ATOMIC_RELAXED);
+    if(limit && used > limit){
+      nsuncharge(ns, s->parent, r, n);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Give back n units of resource r charged by nsreserve().
+void
+nsrelease(struct namespace *ns, int r, int n)
+{
+  nsuncharge(ns, 0, r, n);
+}
+
+// Limit the namespace of process who, a pid in the caller's
+// namespace, to at most limit units of resource r, or lift
+// the limit if it is 0. What it holds already stays; only new
+// charges fail. As with setnsweight(), a process can't change
+// its own namespace's limits.
+int
+setnslimit(int who, int r, int limit)
+{
+  struct proc *p, *me = myproc();
+  struct namespace *ns;
+
+  if(r < 0 || r >= NSLIM || limit < 0)
+    return -1;
+  if((p = findproc(me->ns, who)) == 0)
+    return -1;
+  ns = p->ns;
+  if(ns != me->ns)
+    __atomic_store_n(&ns->limit[r], limit, __ATOMIC_RELAXED);
+  release(&p->lock);
+  return ns != me->ns ? 0 : -1;
+}
+
+// Copy the resource usage and limits of the namespace of
+// process who, or of the caller's namespace if who is 0,
+// to user address addr.
+int
+nsusage(int who, uint64 addr)
+{
+  struct proc *p = 0, *me = myproc();
+  struct namespace *ns = me->ns;
+  struct nsusage u;
+
+  if(who != 0){
+    if((p = findproc(me->ns, who)) == 0)
+      return -1;
+    ns = p->ns;
+  }
+  for(int i = 0; i < NSLIM; i++){
+    u.used[i] = __atomic_load_n(&ns->usage[i], __ATOMIC_RELAXED);
+    u.limit[i] = __atomic_load_n(&ns->limit[i], __ATOMIC_RELAXED);
+  }
+  if(p)
+    release(&p->lock);
+  return copyout(me->pagetable, addr, (char*)&u, sizeof(u));
+}
+
+// Fill m, which has room for NPROC entries, with the processes
+// of namespace root and, unless only is set, of every namespace
+// nested in it. Returns how many there are.
+// Takes namespace locks, parent before child, but no p->lock,
+// since those are taken before namespace locks elsewhere.
+static int
+nsmembers(struct namespace *root, int only, struct nsmember *m)
+{
+  struct namespace *ns = root, *next;
+  struct proc *p;
+  int n = 0;
+
+  // depth first, holding the lock of every namespace on the
+  // way down from root, which keeps the children listed.
+  acquire(&ns->lock);
+  for(;;){
+    for(p = ns->members; p != 0 && n < NPROC; p = p->ns_next){
+      m[n].p = p;
+      m[n].pid = p->pid;
+      m[n].nspid = nspid(p, root);
+      n++;
+    }
+    if(!only && ns->children){
+      ns = ns->children;
+      acquire(&ns->lock);
+      continue;
+    }
+    while(ns != root && ns->sibling == 0){
+      next = ns->parent;
+      release(&ns->lock);
+      ns = next;
+    }
+    if(ns == root)
+      break;
+    next = ns->sibling;
+    release(&ns->lock);
+    ns = next;
+    acquire(&ns->lock);
+  }
+  release(&root->lock);
+  return n;
 }
 
-// Kill the process with the given pid.
+// Kill the process with the given global pid.
 // The victim won't exit until it tries to return
 // to user space (see usertrap() in trap.c).
 int
@@ -860,21 +2044,73 @@ kill(int pid)
 {
   struct proc *p;
 
-  for(p = proc; p < &proc[NPROC]; p++){
-    acquire(&p->lock);
-    if(p->pid == pid){
-      p->killed = 1;
-      if(p->state == SLEEPING){
-        // Wake process from sleep().
-        p->state = RUNNABLE;
-        p->last_runnable = sys_uptime();
+  if((p = findproc(0, pid)) == 0)
+    return -1;
+  killproc(p);
+  release(&p->lock);
+  return 0;
+}
+
+// Kill the process with the given pid in the
+// caller's namespace.
+int
+nskill(int pid)
+{
+  struct proc *p;
+
+  if((p = findproc(myproc()->ns, pid)) == 0)
+    return -1;
+  killproc(p);
+  release(&p->lock);
+  return 0;
+}
+
+// Kill every process of the namespace of process who, a pid
+// in the caller's namespace, and of the namespaces nested in
+// it. As with setnsweight(), that can't be the caller's own
+// namespace. Returns how many processes were killed.
+int
+nskillall(int who)
+{
+  struct proc *p, *me = myproc();
+  struct namespace *ns;
+  struct nsmember *m;
+  int n, found, total = 0;
+
+  if((p = findproc(me->ns, who)) == 0)
+    return -1;
+  ns = p->ns;
+  if(ns == me->ns){
+    release(&p->lock);
+    return -1;
+  }
+  nsdup(ns);
+  release(&p->lock);
+  if((m = (struct nsmember*)kalloc()) == 0){
+    nsput(ns);
+    return -1;
+  }
+
+  // a fork that was under way during one pass shows
+  // up in the next; stop once nothing new is found.
+  do {
+    found = 0;
+    n = nsmembers(ns, 0, m);
+    for(int i = 0; i < n; i++){
+      p = m[i].p;
+      acquire(&p->lock);
+      if(p->pid == m[i].pid && p->state != UNUSED && !p->killed){
+        killproc(p);
+        found++;
       }
       release(&p->lock);
-      return 0;
     }
-    release(&p->lock);
-  }
-  return -1;
+    total += found;
+  } while(found > 0);
+
+  kfree(m);
+  nsput(ns);
+  return total;
 }
 
 void
@@ -959,59 +2195,34 @@ procdump(void)
 // update ps pids and count //
 int
 ps_list(int limit, uint64 pids, int global) {
- 
+  struct proc* me = myproc();
+  struct nsmember* m;
+  int buf[NPROC];
 
-  int count_ps = 0;
-  for (struct proc* p = proc; p < &proc[NPROC]; p++) {
-    if (p->state != UNUSED && compare_ns(p->ns, myproc()->ns))
-      count_ps++;
-  }
-    
+  // just counting: every process counts against its namespace.
+  if (limit <= 0)
+    return __atomic_load_n(&me->ns->usage[NSLIM_PROC], __ATOMIC_RELAXED);
+
+  if ((m = (struct nsmember*) kalloc()) == 0)
+    return -1;
+  int count_ps = nsmembers(me->ns, 0, m);
   if (limit > count_ps)
     limit = count_ps;
+  for (int i = 0; i < limit; i++)
+    buf[i] = global ? m[i].pid : m[i].nspid;
+  kfree(m);
 
-  int index = 0;
-  for (struct proc* p = proc; p < &proc[NPROC]; p++) {
-
-    if (p->state != UNUSED && compare_ns(p->ns, myproc()->ns) && index < limit) {
-
-        acquire(&p->lock);
-
-        int curr_pid = p->pids[myproc()->ns->depth];
-        if (global == 1)
-          curr_pid = p->pid;
-
-        int copy_res = copyout(myproc()->pagetable, pids + index * sizeof(int), (char*) &(curr_pid), sizeof(int));
-        release(&p->lock);
-        if (copy_res != 0)
-          return -1;
-
-        index++;
-      }
-    }
+  if (copyout(me->pagetable, pids, (char*) buf, limit * sizeof(int)) < 0)
+    return -1;
   return count_ps;
 }
 
-// update ps info //
-int 
-ps_info(int pid, uint64 psinfo) {
-
-  struct proc* curr_proc = 0;
-  for (struct proc* p = proc; p < &proc[NPROC]; p++) {
-    acquire(&p->lock);
-    if (p->pid == pid) {
-      curr_proc = p;
-    }
-    release(&p->lock);
-  }
-
-  acquire(&curr_proc->lock);
-
-  uint64 user_ptr = psinfo;
-
-  // state //
-  enum procstate state = curr_proc->state;
-  //state -> str_state
+// fill *pi with p's statistics, with pids as seen from
+// namespace ns.
+// Caller must hold wait_lock and p->lock.
+static void
+fill_info(struct proc *p, struct namespace *ns, struct process_info *pi)
+{
   static char *states[] = {
       [UNUSED]    "unused",
       [USED]      "used",
@@ -1020,174 +2231,120 @@ ps_info(int pid, uint64 psinfo) {
       [RUNNING]   "run   ",
       [ZOMBIE]    "zombie"
   };
-  char* str_state = states[state];
-  int copy_res = copyout(myproc()->pagetable, user_ptr, str_state, sizeof(char) * STATE_SIZE);
-  if (copy_res != 0) {
-    release(&curr_proc->lock);
-    return -1;
-  }
-  //increase user_ptr by size of str_state
-  user_ptr += sizeof(char) * STATE_SIZE;
-
 
+  memset(pi, 0, sizeof(*pi));
+  safestrcpy(pi->state, states[p->state], STATE_SIZE);
 
-  // parent_id //
-  acquire(&wait_lock);//as written in man
+  // the parent's pid is only visible from the same namespace.
+  if (p->parent != 0 && p->ns == p->parent->ns)
+    pi->parent_pid = nspid(p->parent, p->ns);
 
-  struct proc* parent = curr_proc->parent;
-  int parent_pid = 0;
-  if (parent != 0) {
-    acquire(&parent->lock);//lock parent
-    parent_pid = 0;
-    if (curr_proc->ns == curr_proc->parent->ns)
-        parent_pid =  curr_proc->parent->pids[curr_proc->ns->depth];
-    release(&parent->lock);
-  }
-
-  release(&wait_lock);
-
-
-  copy_res = copyout(myproc()->pagetable, user_ptr, (char*) &parent_pid, sizeof(int));
-  if (copy_res != 0) {
-    release(&curr_proc->lock);
-    return -1;
-  }
-  //increase user_ptr by size of PPID field as int
-  user_ptr += sizeof(int);
-
-
-
-  // mem_size //
-  int mem_size = curr_proc->sz;
-
-  copy_res = copyout(myproc()->pagetable, user_ptr, (char*) &mem_size, sizeof(int));
-  if (copy_res != 0) {
-    release(&curr_proc->lock);
-    return -1;
-  }
-  //increase user_ptr by size of mem field as int
-  user_ptr += sizeof(int);
-
-
-
-  // files_count //
-  int files_count = 0;
+  pi->mem_size = p->sz;
   for (int i = 0; i < NOFILE; i++) {
-    if (curr_proc->ofile[i]) {
-      files_count++;
-    }
-  }
-  if (files_count == -1) {
-    release(&curr_proc->lock);
-    return -1;
-  }
-
-  copy_res = copyout(myproc()->pagetable, user_ptr, (char*) &files_count, sizeof(int));
-  if (copy_res != 0) {
-    release(&curr_proc->lock);
-    return -1;
-  }
-  //increase user_ptr by size of mem field as int
-  user_ptr += sizeof(int);
-
-
-  // proc_name //
-  char* proc_name = curr_proc->name;
-
-  copy_res = copyout(myproc()->pagetable, user_ptr, proc_name, sizeof(char) * NAME_SIZE);
-  if (copy_res != 0) {
-    release(&curr_proc->lock);
-    return -1;
-  }
-
-  // time from start //
-  user_ptr += sizeof(char) * NAME_SIZE;
-
-  uint proc_ticks = sys_uptime() - curr_proc->init_ticks;
-
-  copy_res = copyout(myproc()->pagetable, user_ptr, (char*) &proc_ticks, sizeof(uint));
-  if (copy_res != 0) {
-    release(&curr_proc->lock);
-    return -1;
-  }
-
-
-  // real time //
-  user_ptr += sizeof(uint);
-
-  copy_res = copyout(myproc()->pagetable, user_ptr, (char*) &(curr_proc->run_time), sizeof(uint));
-  if (copy_res != 0) {
-    release(&curr_proc->lock);
-    return -1;
+    if (p->ofile[i])
+      pi->files_count++;
   }
-
-  // context_switches //
-  user_ptr += sizeof(uint);
-
-  copy_res = copyout(myproc()->pagetable, user_ptr, (char*) &(curr_proc->context_switches), sizeof(uint));
-  if (copy_res != 0) {
-    release(&curr_proc->lock);
-    return -1;
+  safestrcpy(pi->proc_name, p->name, NAME_SIZE);
+
+  // time //
+  pi->proc_ticks = sys_uptime() - p->init_ticks;
+  pi->run_time = p->run_time;
+  pi->context_switches = p->context_switches;
+  pi->user_ticks = p->run_time - p->kernel_time;
+  pi->kernel_ticks = p->kernel_time;
+  pi->waiting_ticks = p->waiting_time;
+  pi->priority = p->prio;
+  pi->nice = p->nice;
+  for (int k = 0; k < NPRIO; k++) {
+    pi->prio_run[k] = p->prio_run[k];
+    pi->prio_wait[k] = p->prio_wait[k];
   }
 
+  // memory //
+  pi->bytes_read = p->read_b;
+  pi->bytes_write = p->write_b;
+  pi->pages_count = p->heap_pages;
 
-  // user time //
-  user_ptr += sizeof(uint);
-
-  uint user_time = curr_proc->run_time - curr_proc->kernel_time;
+  pi->pid = p->pid;
+  pi->ns_pid = nspid(p, ns);
 
-  copy_res = copyout(myproc()->pagetable, user_ptr, (char*) &(user_time), sizeof(uint));
-  if (copy_res != 0) {
-    release(&curr_proc->lock);
-    return -1;
-  }
+  // namespace //
+  pi->ns_weight = p->ns->weight;
+  pi->ns_ticks = p->ns->ticks;
+}
 
-  // kernel time //
-  user_ptr += sizeof(uint);
+// update ps info //
+int 
+ps_info(int pid, uint64 psinfo) {
+  struct proc* me = myproc();
+  struct process_info pi;
 
-  copy_res = copyout(myproc()->pagetable, user_ptr, (char*) &(curr_proc->kernel_time), sizeof(uint));
-  if (copy_res != 0) {
-    release(&curr_proc->lock);
+  acquire(&wait_lock);  // for p->parent
+  struct proc* curr_proc = findproc(0, pid);
+  if (curr_proc == 0) {
+    release(&wait_lock);
     return -1;
   }
+  fill_info(curr_proc, me->ns, &pi);
+  release(&curr_proc->lock);
+  release(&wait_lock);
 
-  // waiting time //
-  user_ptr += sizeof(uint);
+  return copyout(me->pagetable, psinfo, (char*) &pi, sizeof(pi));
+}
 
-  copy_res = copyout(myproc()->pagetable, user_ptr, (char*) &(curr_proc->waiting_time), sizeof(uint));
-  if (copy_res != 0) {
-    release(&curr_proc->lock);
+// copy a process_info record for every process visible from the
+// caller's namespace (or only those in it, with PS_NSONLY) to the
+// array at addr, at most max of them.
+// returns the number of visible processes, which may exceed max.
+int
+ps_snapshot(uint64 addr, int max, int flags) {
+  struct proc* me = myproc();
+  struct process_info* buf;
+  struct nsmember* m;
+  int nbuf = PGSIZE / sizeof(struct process_info);
+  int n = 0, total = 0, copied = 0, nm;
+
+  if ((buf = (struct process_info*) kalloc()) == 0)
     return -1;
-  }
-
-    // bytes read //
-  user_ptr += sizeof(uint);
-
-  copy_res = copyout(myproc()->pagetable, user_ptr, (char*) &(curr_proc->read_b), sizeof(uint));
-  if (copy_res != 0) {
-    release(&curr_proc->lock);
+  if ((m = (struct nsmember*) kalloc()) == 0) {
+    kfree(buf);
     return -1;
   }
+  nm = nsmembers(me->ns, flags & PS_NSONLY, m);
 
-  // bytes write //
-  user_ptr += sizeof(uint);
+  acquire(&wait_lock);
+  for (int i = 0; i < nm; i++) {
+    struct proc* p = m[i].p;
+    acquire(&p->lock);
+    if (p->state == UNUSED || p->pid != m[i].pid) {
+      release(&p->lock);
+      continue;
+    }
+    if (total < max)
+      fill_info(p, me->ns, &buf[n++]);
+    total++;
+    release(&p->lock);
 
-  copy_res = copyout(myproc()->pagetable, user_ptr, (char*) &(curr_proc->write_b), sizeof(uint));
-  if (copy_res != 0) {
-    release(&curr_proc->lock);
-    return -1;
+    // copyout may sleep, so flush full batches without the locks.
+    if (n == nbuf) {
+      release(&wait_lock);
+      if (copyout(me->pagetable, addr + copied * sizeof(*buf), (char*) buf, n * sizeof(*buf)) < 0) {
+        kfree(buf);
+        kfree(m);
+        return -1;
+      }
+      copied += n;
+      n = 0;
+      acquire(&wait_lock);
+    }
   }
+  release(&wait_lock);
 
-  // pages //
-  user_ptr += sizeof(uint);
-
-  copy_res = copyout(myproc()->pagetable, user_ptr, (char*) &(curr_proc->heap_pages), sizeof(uint));
-  if (copy_res != 0) {
-    release(&curr_proc->lock);
+  kfree(m);
+  if (n > 0 && copyout(me->pagetable, addr + copied * sizeof(*buf), (char*) buf, n * sizeof(*buf)) < 0) {
+    kfree(buf);
     return -1;
   }
-
-  //release last
-  release(&curr_proc->lock);
-  return 0;
-}
\ No newline at end of file
+  kfree(buf);
+  return total;
+}
@@ -18,12 +18,54 @@ struct context {
   uint64 s11;
 };
 
+// A region of user memory filled in on first touch, from a
+// file or with zeroes, instead of when it is set up. See vma.c.
+struct vma {
+  uint64 start;                // Page-aligned; start == end if unused
+  uint64 end;
+  int perm;                    // PTE_W and PTE_X bits of its pages
+  int flags;                   // VMA_MMAP, VMA_SHARED
+  struct inode *ip;            // File holding the contents
+  uint off;                    // File offset of start
+  uint filesz;                 // Bytes of file data; the rest reads as zero
+};
+
+#define VMA_MMAP    0x1        // made by mmap(), above p->sz
+#define VMA_SHARED  0x2        // pages stay shared across fork()
+
+// The RUNNABLE processes of one namespace on one cpu's run
+// queue, linked through p->rq_next: one FIFO per priority
+// level; a process waits in the one for its p->qprio.
+// Guarded by that run queue's lock.
+struct nsqueue {
+  struct proc *head[NPRIO];   // Next process to run at each level.
+  struct proc *tail[NPRIO];   // Most recently queued process.
+  int len;                    // Number of queued processes.
+  struct nsqueue *next;       // Next namespace on the run queue.
+};
+
+// Per-CPU queue of RUNNABLE processes, kept per namespace so
+// that picking one costs the number of namespaces present,
+// not the number of processes.
+struct runqueue {
+  struct spinlock lock;
+  struct nsqueue *nsq;        // Namespaces with processes queued here.
+  int nlevel[NPRIO];          // Queued processes at each level.
+  int len;                    // Number of queued processes.
+};
+
 // Per-CPU state.
 struct cpu {
   struct proc *proc;          // The process running on this cpu, or null.
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  struct runqueue rq;         // RUNNABLE processes waiting for this cpu.
+  int online;                 // Has entered scheduler().
+  int idle;                   // Waiting in wfi for work; see kickidle().
+  uint64 idlestart;           // When the current wait began.
+  uint64 idletime;            // Time spent idle, in timer cycles.
+  uint64 wakeups;             // Times it left wfi.
 };
 
 extern struct cpu cpus[NCPU];
@@ -82,6 +124,13 @@ struct trapframe {
 enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 
+// A process exit, as wait_ns() reports it.
+struct nsevent {
+  int pid;      // global pid
+  int nspid;    // pid in the namespace the event was posted to
+  int status;
+};
+
 // Per-namespace state
 struct namespace {
   struct spinlock lock;
@@ -89,15 +138,54 @@ struct namespace {
   struct namespace* parent;
   struct proc* head;
 
+  // ns->lock must be held when using these:
+  struct proc *members;          // processes whose p->ns is this one
+  struct namespace *children;    // namespaces nested directly in it
+
+  // parent->lock must be held when using these:
+  struct namespace *sibling;     // next child of the same parent
+  struct namespace **sibling_pprev;
+
   int ns_id;
   int depth; 
    
-  int used;
+  int ref;                 // processes, child namespaces and files in it
   int next_ns_pid;
-  int num_proc;
+  int prio;                // least nice value of processes created in it
+
+  // sharelock must be held when changing these (see sharebefore()):
+  int weight;              // cpu share against sibling namespaces
+  uint ticks;              // ticks used by it and the namespaces in it
+  uint64 vtime;            // the same ticks, each counted VSCALE/weight
+  uint64 vself;            // ticks of its own processes, VSCALE/NSWEIGHT each
+  uint64 vmax;             // largest of vself and its children's vtime
+
+  // updated atomically; see nsreserve():
+  int usage[NSLIM];        // resources held in it and the namespaces in it
+  int limit[NSLIM];        // most it may hold, 0 for no limit
+
+  struct procstat* stats;  // page of per-process statistics, see procstat.h
+
+  struct nsqueue rq[NCPU]; // its processes on each cpu's run queue
+
+  // exits in it and the namespaces in it, newest at evseq-1.
+  struct spinlock evlock;  // protects events and evseq
+  struct nsevent events[NNSEVENT];
+  uint evseq;              // exits ever posted
 };
 
 
+// Entry in the pid index, mapping a pid to its process.
+// ns is 0 for the global pid, else the namespace in
+// which pid is the process's local pid.
+struct pidnode {
+  struct pidnode *next;
+  struct namespace *ns;
+  int pid;
+  struct proc *proc;
+  struct pidnode *outer;   // the process's pid in ns->parent
+};
+
 // Per-process state
 struct proc {
   struct spinlock lock;
@@ -108,18 +196,41 @@ struct proc {
   int killed;                  // If non-zero, have been killed
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
+  int cpu;                     // Run queue p was last placed on
+  int nice;                    // Highest level p may run at; see setpriority()
+
+  int prio;                    // Scheduling level, from nice to NPRIO-1
+  int slice;                   // Timer ticks used at this level
+  uint epoch;                  // Last boost applied to prio
 
-  // wait_lock must be held when using this:
+  // the run queue's lock must be held when using these:
+  struct proc *rq_next;        // Next process in the run queue
+  int qprio;                   // Level p is queued at
+  int qnice;                   // p->nice when it was queued
+
+  // procfree.lock must be held when using this:
+  struct proc *free_next;      // Next UNUSED process in the free list
+
+  // the sleep queue's lock must be held when using these:
+  struct proc *sq_next;        // Next sleeper in the same hash bucket
+  struct proc **sq_pprev;      // Link pointing at p, or 0 if not queued
+
+  // wait_lock must be held when using these:
   struct proc *parent;         // Parent process
+  struct proc *children;       // First child
+  struct proc *sibling;        // Next child of the same parent
+  struct proc **sibling_pprev; // Link pointing at p, or 0 if no parent
 
   // these are private to the process, so p->lock need not be held.
   uint64 kstack;               // Virtual address of kernel stack
   uint64 sz;                   // Size of process memory (bytes)
   pagetable_t pagetable;       // User page table
+  pagetable_t kpagetable;      // Kernel page table, with user memory at UALIAS
   struct trapframe *trapframe; // data page for trampoline.S
   struct context context;      // swtch() here to run process
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
+  struct vma vmas[NVMA];       // Regions paged in from files
   char name[16];               // Process name (debugging)
 
   uint init_ticks;
@@ -131,6 +242,8 @@ struct proc {
   uint kernel_time;
   uint last_kernel_time;
   uint waiting_time;
+  uint prio_run[NPRIO];        // run_time, by level
+  uint prio_wait[NPRIO];       // waiting_time, by level
 
   int is_kernel;
 
@@ -141,5 +254,15 @@ struct proc {
 
   // namespaces features
    struct namespace* ns;
-   int pids[MAXDEPTH];
+
+  // pid index entries: the global pid, and a list of
+  // the pids in ns and each namespace enclosing it.
+  struct pidnode gpidnode;
+  struct pidnode *pidnodes;
+
+  uint evseq;                  // Next of ns's exit events for wait_ns()
+
+  // ns->lock must be held when using these:
+  struct proc *ns_next;        // Next member of the same namespace
+  struct proc **ns_pprev;      // Link pointing at p, or 0 if not a member
 };
\ No newline at end of file
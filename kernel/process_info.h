@@ -15,8 +15,22 @@ struct process_info {
     int user_ticks;
     int kernel_ticks;
     int waiting_ticks;
+    //scheduling (levels up to NPRIO, from param.h)
+    int priority;
+    int nice;
+    int prio_run[NPRIO];   // run_time by level
+    int prio_wait[NPRIO];  // waiting_ticks by level
     //memeory
     int bytes_read;
     int bytes_write;
     int pages_count;
-};
\ No newline at end of file
+    //pids
+    int pid;      // global pid
+    int ns_pid;   // pid in the caller's namespace
+    //namespace
+    int ns_weight;  // cpu weight of the process's namespace
+    int ns_ticks;   // cpu ticks used by it and the namespaces in it
+};
+
+// ps_snapshot flags
+#define PS_NSONLY 1   // skip processes of nested namespaces
\ No newline at end of file
@@ -0,0 +1,25 @@
+// Per-process statistics that the kernel publishes in a
+// read-only page mapped at USTATS in every process, so that
+// monitors can sample them without system calls.
+//
+// Each namespace has its own page, holding one slot per
+// process table entry; a process appears in the page of its
+// namespace and of every enclosing one, under its pid there.
+//
+// The kernel makes seq odd while it updates a slot and even
+// again when done. A reader copies the slot and retries if
+// seq was odd or changed in the meantime.
+struct procstat {
+  uint seq;
+  int pid;                // pid in this page's namespace, 0 if unused
+  int state;              // enum procstate
+  uint run_time;
+  uint context_switches;
+  uint waiting_time;
+  uint read_b;
+  uint write_b;
+  uint heap_pages;
+  char name[16];
+  int prio;               // scheduling level
+  uint pad[2];            // round up to 64 bytes
+};
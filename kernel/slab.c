@@ -0,0 +1,164 @@
+// Slab allocator for kernel objects smaller than a page.
+//
+// Each kmem_cache hands out objects of one size, carved out
+// of page-sized slabs taken from kalloc(). A slab starts with
+// a header and keeps its free objects on a list threaded
+// through their first word. Slabs with free objects are linked
+// into the cache; full slabs are found again from an object's
+// address, since a slab is one aligned page.
+//
+// In front of the slabs each cpu has a magazine of free objects,
+// used with interrupts off and no lock. Objects move between a
+// magazine and the slabs MAGSIZE/2 at a time under the cache
+// lock. A slab that becomes empty goes back to kalloc() unless
+// it is the cache's only spare.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "slab.h"
+#include "defs.h"
+
+struct slab {
+  struct slab *next;       // in the cache's list of non-full slabs
+  struct slab *prev;
+  void *free;              // free objects in this slab
+  uint inuse;
+};
+
+#define SLABHDR ((sizeof(struct slab) + 7) & ~7)
+
+void
+kmem_cache_init(struct kmem_cache *c, char *name, uint size)
+{
+  initlock(&c->lock, name);
+  c->name = name;
+  c->size = (size + 7) & ~7;
+  if(c->size < sizeof(void*))
+    c->size = sizeof(void*);
+  if(c->size > PGSIZE - SLABHDR)
+    panic("kmem_cache_init: size");
+  c->perslab = (PGSIZE - SLABHDR) / c->size;
+  c->slabs = 0;
+  c->nslab = 0;
+  c->nfree = 0;
+  for(int i = 0; i < NCPU; i++)
+    c->mag[i].n = 0;
+}
+
+static void
+slab_link(struct kmem_cache *c, struct slab *s)
+{
+  s->prev = 0;
+  s->next = c->slabs;
+  if(s->next)
+    s->next->prev = s;
+  c->slabs = s;
+}
+
+static void
+slab_unlink(struct kmem_cache *c, struct slab *s)
+{
+  if(s->prev)
+    s->prev->next = s->next;
+  else
+    c->slabs = s->next;
+  if(s->next)
+    s->next->prev = s->prev;
+}
+
+// take one object from the slabs, adding a slab if
+// they are all full. caller holds c->lock.
+static void *
+slab_get(struct kmem_cache *c)
+{
+  struct slab *s;
+  void *obj;
+
+  if((s = c->slabs) == 0){
+    if((s = (struct slab*)kalloc()) == 0)
+      return 0;
+    s->free = 0;
+    s->inuse = 0;
+    for(int i = c->perslab - 1; i >= 0; i--){
+      obj = (char*)s + SLABHDR + i * c->size;
+      *(void**)obj = s->free;
+      s->free = obj;
+    }
+    slab_link(c, s);
+    c->nslab++;
+    c->nfree += c->perslab;
+  }
+
+  obj = s->free;
+  s->free = *(void**)obj;
+  s->inuse++;
+  c->nfree--;
+  if(s->free == 0)
+    slab_unlink(c, s);
+  return obj;
+}
+
+// return an object to its slab. caller holds c->lock.
+static void
+slab_put(struct kmem_cache *c, void *obj)
+{
+  struct slab *s = (struct slab*)PGROUNDDOWN((uint64)obj);
+
+  if(s->free == 0)
+    slab_link(c, s);
+  *(void**)obj = s->free;
+  s->free = obj;
+  s->inuse--;
+  c->nfree++;
+  if(s->inuse == 0 && c->nfree > c->perslab){
+    slab_unlink(c, s);
+    c->nslab--;
+    c->nfree -= c->perslab;
+    kfree((void*)s);
+  }
+}
+
+// Allocate a zeroed object from cache c.
+// Returns 0 if out of memory.
+void *
+kmem_cache_alloc(struct kmem_cache *c)
+{
+  struct magazine *m;
+  void *obj;
+
+  push_off();
+  m = &c->mag[cpuid()];
+  if(m->n == 0){
+    acquire(&c->lock);
+    while(m->n < MAGSIZE/2 && (obj = slab_get(c)) != 0)
+      m->objs[m->n++] = obj;
+    release(&c->lock);
+  }
+  obj = m->n > 0 ? m->objs[--m->n] : 0;
+  pop_off();
+
+  if(obj)
+    memset(obj, 0, c->size);
+  return obj;
+}
+
+// Free an object allocated from cache c.
+void
+kmem_cache_free(struct kmem_cache *c, void *obj)
+{
+  struct magazine *m;
+
+  push_off();
+  m = &c->mag[cpuid()];
+  if(m->n == MAGSIZE){
+    acquire(&c->lock);
+    while(m->n > MAGSIZE/2)
+      slab_put(c, m->objs[--m->n]);
+    release(&c->lock);
+  }
+  m->objs[m->n++] = obj;
+  pop_off();
+}
@@ -0,0 +1,21 @@
+// Object caches for fixed-size kernel structures.
+// See slab.c.
+
+#define MAGSIZE 16   // objects in a per-cpu magazine
+
+// objects a cpu can hand out without taking the cache lock.
+struct magazine {
+  int n;
+  void *objs[MAGSIZE];
+};
+
+struct kmem_cache {
+  struct spinlock lock;
+  char *name;
+  uint size;           // object size, rounded up to 8 bytes
+  uint perslab;        // objects in one slab page
+  struct slab *slabs;  // slabs with at least one free object
+  uint nslab;          // slab pages held
+  uint nfree;          // free objects in those slabs
+  struct magazine mag[NCPU];
+};
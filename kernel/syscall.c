@@ -115,6 +115,19 @@ extern uint64 sys_ps_info(void);
 extern uint64 sys_clone(void);
 extern uint64 sys_getppid(void);
 extern uint64 sys_ps_list_global(void);
+extern uint64 sys_yield(void);
+extern uint64 sys_nskill(void);
+extern uint64 sys_ps_snapshot(void);
+extern uint64 sys_memstat(void);
+extern uint64 sys_mmap(void);
+extern uint64 sys_munmap(void);
+extern uint64 sys_cpustat(void);
+extern uint64 sys_setpriority(void);
+extern uint64 sys_setnsweight(void);
+extern uint64 sys_setnslimit(void);
+extern uint64 sys_nsusage(void);
+extern uint64 sys_nskillall(void);
+extern uint64 sys_wait_ns(void);
 
 // An array mapping syscall numbers from syscall.h
 // to the function that handles the system call.
@@ -144,7 +157,21 @@ static uint64 (*syscalls[])(void) = {
 [SYS_ps_list]   sys_ps_list,
 [SYS_ps_info]   sys_ps_info,
 [SYS_clone]   sys_clone,
+[SYS_getppid] sys_getppid,
 [SYS_ps_list_global] sys_ps_list_global,
+[SYS_yield]   sys_yield,
+[SYS_nskill]  sys_nskill,
+[SYS_ps_snapshot] sys_ps_snapshot,
+[SYS_memstat] sys_memstat,
+[SYS_mmap]    sys_mmap,
+[SYS_munmap]  sys_munmap,
+[SYS_cpustat] sys_cpustat,
+[SYS_setpriority] sys_setpriority,
+[SYS_setnsweight] sys_setnsweight,
+[SYS_setnslimit] sys_setnslimit,
+[SYS_nsusage] sys_nsusage,
+[SYS_nskillall] sys_nskillall,
+[SYS_wait_ns] sys_wait_ns,
 };
 
 void
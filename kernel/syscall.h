@@ -26,4 +26,17 @@
 #define SYS_ps_info 24
 #define SYS_clone   25
 #define SYS_getppid 26
-#define SYS_ps_list_global 27
\ No newline at end of file
+#define SYS_ps_list_global 27
+#define SYS_yield   28
+#define SYS_nskill  29
+#define SYS_ps_snapshot 30
+#define SYS_memstat 31
+#define SYS_mmap    32
+#define SYS_munmap  33
+#define SYS_cpustat 34
+#define SYS_setpriority 35
+#define SYS_setnsweight 36
+#define SYS_setnslimit 37
+#define SYS_nsusage 38
+#define SYS_nskillall 39
+#define SYS_wait_ns 40
\ No newline at end of file
@@ -3,11 +3,11 @@
 // Mostly argument checking, since we don't trust
 // user code, and calls into file.c and fs.c.
 //
-#include "process_info.h"
 #include "types.h"
 #include "riscv.h"
 #include "defs.h"
 #include "param.h"
+#include "process_info.h"
 #include "stat.h"
 #include "spinlock.h"
 #include "proc.h"
@@ -15,6 +15,7 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "mman.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -98,6 +99,47 @@ sys_ps_info(void) {
   return ps_info(pid, psinfo);
 }
 
+uint64
+sys_ps_snapshot(void) {
+  uint64 buf;
+  int max, flags;
+
+  argaddr(0, &buf);
+  argint(1, &max);
+  argint(2, &flags);
+
+  return ps_snapshot(buf, max, flags);
+}
+
+uint64
+sys_mmap(void)
+{
+  uint64 addr, len;
+  int prot, flags, off;
+  struct file *f = 0;
+
+  argaddr(0, &addr);
+  argaddr(1, &len);
+  argint(2, &prot);
+  argint(3, &flags);
+  argint(5, &off);
+  if(off < 0)
+    return -1;
+  if((flags & MAP_ANONYMOUS) == 0 && argfd(4, 0, &f) < 0)
+    return -1;
+  return mmap(addr, len, prot, flags, f, off);
+}
+
+uint64
+sys_munmap(void)
+{
+  uint64 addr, len;
+
+  argaddr(0, &addr);
+  argaddr(1, &len);
+  return munmap(addr, len);
+}
+
 uint64
 sys_read(void)
 {
@@ -114,6 +156,7 @@ sys_read(void)
   struct proc *ps = myproc();
   acquire(&ps->lock);
   ps->read_b += bytes;
+  ps_publish(ps);
   release(&ps->lock);
   return bytes;
 }
@@ -134,6 +177,7 @@ sys_write(void)
   struct proc *ps = myproc();
   acquire(&ps->lock);
   ps->write_b += bytes;
+  ps_publish(ps);
   release(&ps->lock);
   return bytes;
 }
@@ -5,6 +5,8 @@
 #include "memlayout.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "memstat.h"
+#include "cpustat.h"
 
 uint64
 sys_exit(void)
@@ -19,17 +21,13 @@ uint64
 sys_getpid(void)
 {
   struct proc* p = myproc();
-  return p->pids[p->ns->depth];
+  return p->pidnodes->pid;   // pid in its own namespace
 }
 
 uint64
 sys_getppid(void)
 {
-  struct proc* p = myproc();
-  if (p->ns == p->parent->ns) {   // if same ns
-    return p->parent->pids[p->ns->depth];   // return ppid in this ns
-  }
-  return 0; // else
+  return getppid();
 }
 
 uint64
@@ -44,6 +42,78 @@ sys_fork(void)
   return fork();
 }
 
+uint64
+sys_setpriority(void)
+{
+  int which, who, prio;
+
+  argint(0, &which);
+  argint(1, &who);
+  argint(2, &prio);
+  return setpriority(which, who, prio);
+}
+
+uint64
+sys_setnsweight(void)
+{
+  int who, weight;
+
+  argint(0, &who);
+  argint(1, &weight);
+  return setnsweight(who, weight);
+}
+
+uint64
+sys_setnslimit(void)
+{
+  int who, r, limit;
+
+  argint(0, &who);
+  argint(1, &r);
+  argint(2, &limit);
+  return setnslimit(who, r, limit);
+}
+
+uint64
+sys_nsusage(void)
+{
+  int who;
+  uint64 addr;
+
+  argint(0, &who);
+  argaddr(1, &addr);
+  return nsusage(who, addr);
+}
+
+uint64
+sys_nskillall(void)
+{
+  int who;
+
+  argint(0, &who);
+  return nskillall(who);
+}
+
+uint64
+sys_wait_ns(void)
+{
+  int flags;
+  uint64 addr, pidaddr;
+
+  argint(0, &flags);
+  argaddr(1, &addr);
+  argaddr(2, &pidaddr);
+  return wait_ns(flags, addr, pidaddr);
+}
+
+// give up the cpu to another runnable process.
+uint64
+sys_yield(void)
+{
+  yield();
+  return 0;
+}
+
 uint64
 sys_wait(void)
 {
@@ -94,6 +164,60 @@ sys_kill(void)
   return kill(pid);
 }
 
+// kill by pid as seen from the caller's namespace.
+uint64
+sys_nskill(void)
+{
+  int pid;
+
+  argint(0, &pid);
+  return nskill(pid);
+}
+
+// report free physical memory.
+uint64
+sys_memstat(void)
+{
+  struct memstat ms;
+  uint64 addr;
+
+  argaddr(0, &addr);
+  kmemstat(&ms);
+  ms.pagecache = pcpages();
+  if(copyout(myproc()->pagetable, addr, (char*)&ms, sizeof(ms)) < 0)
+    return -1;
+  return 0;
+}
+
+// Fill in up to n struct cpustat, one per hart that is
+// running, and return how many.
+uint64
+sys_cpustat(void)
+{
+  struct cpustat st;
+  struct cpu *c;
+  uint64 addr;
+  int n, k = 0;
+
+  argaddr(0, &addr);
+  argint(1, &n);
+  for(c = cpus; c < &cpus[NCPU] && k < n; c++){
+    if(!c->online)
+      continue;
+    st.hart = c - cpus;
+    st.time = r_time();
+    st.idle = c->idletime;
+    // count a wait that is still going on.
+    if(__atomic_load_n(&c->idle, __ATOMIC_SEQ_CST))
+      st.idle += st.time - c->idlestart;
+    st.wakeups = c->wakeups;
+    if(copyout(myproc()->pagetable, addr + k*sizeof(st), (char*)&st, sizeof(st)) < 0)
+      return -1;
+    k++;
+  }
+  return k;
+}
+
 // return how many clock tick interrupts have occurred
 // since start.
 uint64
@@ -10,11 +10,13 @@ struct spinlock tickslock;
 uint ticks;
 
 extern char trampoline[], uservec[], userret[];
+extern char ucopy_start[], ucopy_end[], ucopy_fault[];
 
 // in kernelvec.S, calls kerneltrap().
 void kernelvec();
 
 extern int devintr();
+extern uint64 timer_scratch[NCPU][7]; // start.c
 
 void
 trapinit(void)
@@ -70,6 +72,15 @@ usertrap(void)
     intr_on();
 
     syscall();
+  } else if(r_scause() == 15 && uvmcow(p->pagetable, r_stval()) == 0){
+    // store to a copy-on-write page, now copied
+  } else if((r_scause() == 12 || r_scause() == 13 || r_scause() == 15) &&
+            uvmlazy(p->pagetable, r_stval()) == 0){
+    // first touch of a program or heap page, now mapped.
+    // the store it retries will dirty it, but say so now
+    // in case the hardware leaves PTE_D to software.
+    if(r_scause() == 15)
+      uvmdirty(p->pagetable, r_stval());
   } else if((which_dev = devintr()) != 0){
     // ok
   } else {
@@ -81,9 +92,9 @@ usertrap(void)
   if(killed(p))
     exit(-1);
 
-  // give up the CPU if this is a timer interrupt.
+  // charge a timer interrupt to the time slice.
   if(which_dev == 2)
-    yield();
+    schedtick();
 
   //back to user
   p->is_kernel = 0;
@@ -153,15 +164,30 @@ kerneltrap()
   if(intr_get() != 0)
     panic("kerneltrap: interrupts enabled");
 
+  // a page fault in ucopy() or ucopystr() on user memory
+  // makes them return -1; see usercopy.S. any other fault
+  // there is a kernel bug.
+  if((scause == 13 || scause == 15) &&
+     sepc >= (uint64)ucopy_start && sepc < (uint64)ucopy_end &&
+     r_stval() >= UALIAS){
+    w_sepc((uint64)ucopy_fault);
+    return;
+  }
+
+  // an interrupt in ucopy() finds SUM set. sstatus belongs to
+  // the hart, so clear SUM in case the timer makes this process
+  // yield; w_sstatus() below restores it.
+  w_sstatus(sstatus & ~SSTATUS_SUM);
+
   if((which_dev = devintr()) == 0){
     printf("scause %p\n", scause);
     printf("sepc=%p stval=%p\n", r_sepc(), r_stval());
     panic("kerneltrap");
   }
 
-  // give up the CPU if this is a timer interrupt.
+  // charge a timer interrupt to the time slice.
   if(which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING)
-    yield();
+    schedtick();
 
   // the yield() may have caused some traps to occur,
   // so restore trap registers for use by kernelvec.S's sepc instruction.
@@ -176,6 +202,9 @@ clockintr()
   ticks++;
   wakeup(&ticks);
   release(&tickslock);
+
+  if(ticks % BOOSTTICKS == 0)
+    schedboost();
 }
 
 // check if it's an external interrupt or software interrupt,
@@ -212,16 +241,21 @@ devintr()
     return 1;
   } else if(scause == 0x8000000000000001L){
     // software interrupt from a machine-mode timer interrupt,
+    // or from another hart waking this one (see kickidle()),
     // forwarded by timervec in kernelvec.S.
 
-    if(cpuid() == 0){
-      clockintr();
-    }
-    
     // acknowledge the software interrupt by clearing
     // the SSIP bit in sip.
     w_sip(r_sip() & ~2);
 
+    // only a wakeup, which has done its job already.
+    if(__atomic_exchange_n(&timer_scratch[cpuid()][6], 0, __ATOMIC_SEQ_CST) == 0)
+      return 1;
+
+    if(cpuid() == 0){
+      clockintr();
+    }
+
     return 2;
   } else {
     return 0;
@@ -7,6 +7,7 @@
 #include "fs.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "nslimit.h"
 
 
 
@@ -37,6 +38,9 @@ kvmmake(void)
   // virtio mmio disk interface
   kvmmap(kpgtbl, VIRTIO0, VIRTIO0, PGSIZE, PTE_R | PTE_W);
 
+  // CLINT's software interrupt registers, to wake idle harts.
+  kvmmap(kpgtbl, CLINT, CLINT, PGSIZE, PTE_R | PTE_W);
+
   // PLIC
   kvmmap(kpgtbl, PLIC, PLIC, 0x400000, PTE_R | PTE_W);
 
@@ -63,6 +67,60 @@ kvminit(void)
   kernel_pagetable = kvmmake();
 }
 
+// top-level entries that map user memory; the same number
+// of entries above them map it at UALIAS.
+#define NUPTE (MAXVA >> PXSHIFT(2))
+
+// Make a kernel page table for a process: the kernel's own
+// mappings, plus its user memory once uvmmirror() fills it in.
+// Only the top-level page is private.
+pagetable_t
+kvmproc(void)
+{
+  pagetable_t kpt;
+
+  if((kpt = (pagetable_t)kalloc_zeroed()) == 0)
+    return 0;
+  memmove(kpt, kernel_pagetable, NUPTE * sizeof(pte_t));
+  return kpt;
+}
+
+// Point the UALIAS half of p's kernel page table at the
+// top-level entries of its user page table. The tables below
+// are shared, so this is only needed when one is added, or
+// when p gets a new user page table.
+void
+uvmmirror(struct proc *p)
+{
+  memmove(&p->kpagetable[NUPTE], p->pagetable, NUPTE * sizeof(pte_t));
+  sfence_vma();
+}
+
+// Can [va, va+len) of pagetable be copied through UALIAS?
+// Only the current process's memory is mapped there, and
+// nothing from TRAPFRAME up, which the kernel could write
+// despite PTE_U being clear.
+static int
+ucopyok(pagetable_t pagetable, uint64 va, uint64 len)
+{
+  struct proc *p = myproc();
+
+  return p != 0 && p->pagetable == pagetable &&
+    va < TRAPFRAME && len <= TRAPFRAME - va;
+}
+
+// The TLB may still hold old PTEs of the current process's
+// memory at UALIAS, which copyin() and copyout() would use;
+// flush it after changing or adding a PTE in pagetable.
+static void
+uvmflush(pagetable_t pagetable)
+{
+  struct proc *p = myproc();
+
+  if(p != 0 && p->pagetable == pagetable)
+    sfence_vma();
+}
+
 // Switch h/w page table register to the kernel's page table,
 // and enable paging.
 void
@@ -77,6 +135,28 @@ kvminithart()
   sfence_vma();
 }
 
+// Like walk(), but return the PTE at level stop (0 or 1).
+static pte_t *
+walklevel(pagetable_t pagetable, uint64 va, int alloc, int stop)
+{
+  if(va >= MAXVA)
+    panic("walk");
+
+  for(int level = 2; level > stop; level--) {
+    pte_t *pte = &pagetable[PX(level, va)];
+    if(*pte & PTE_V) {
+      if(PTE_LEAF(*pte))
+        return pte;
+      pagetable = (pagetable_t)PTE2PA(*pte);
+    } else {
+      if(!alloc || (pagetable = (pde_t*)kalloc_zeroed()) == 0)
+        return 0;
+      *pte = PA2PTE(pagetable) | PTE_V;
+    }
+  }
+  return &pagetable[PX(stop, va)];
+}
+
 // Return the address of the PTE in page table pagetable
 // that corresponds to virtual address va.  If alloc!=0,
 // create any required page-table pages.
@@ -89,24 +169,106 @@ kvminithart()
 //   21..29 -- 9 bits of level-1 index.
 //   12..20 -- 9 bits of level-0 index.
 //    0..11 -- 12 bits of byte offset within the page.
+//
+// A leaf PTE at level 1 maps a whole 2 MiB megapage; if the
+// walk meets one, it returns that PTE.
 pte_t *
 walk(pagetable_t pagetable, uint64 va, int alloc)
 {
-  if(va >= MAXVA)
-    panic("walk");
+  return walklevel(pagetable, va, alloc, 0);
+}
 
-  for(int level = 2; level > 0; level--) {
-    pte_t *pte = &pagetable[PX(level, va)];
-    if(*pte & PTE_V) {
-      pagetable = (pagetable_t)PTE2PA(*pte);
-    } else {
-      if(!alloc || (pagetable = (pde_t*)kalloc()) == 0)
-        return 0;
-      memset(pagetable, 0, PGSIZE);
-      *pte = PA2PTE(pagetable) | PTE_V;
+// The level-1 PTE for va if it maps a megapage, else 0.
+static pte_t *
+megapte(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte = walklevel(pagetable, va, 0, 1);
+
+  if(pte && (*pte & PTE_V) && PTE_LEAF(*pte))
+    return pte;
+  return 0;
+}
+
+// Give pagetable a private copy, mapped with flags, of the
+// megapage that fork() shared and pte maps: another megapage
+// if one is free and split is 0, else 512 ordinary pages.
+// Returns -1, changing nothing, if memory runs out.
+static int
+megacopy(pte_t *pte, uint flags, int split)
+{
+  uint64 pa = PTE2PA(*pte);
+  pagetable_t l0;
+  char *mem;
+  int i;
+
+  if(!split && (mem = kalloc_order(MEGAORDER)) != 0){
+    memmove(mem, (char*)pa, MEGASIZE);
+    *pte = PA2PTE(mem) | flags;
+  } else {
+    if((l0 = (pagetable_t)kalloc_zeroed()) == 0)
+      return -1;
+    for(i = 0; i < 512; i++){
+      if((mem = kalloc()) == 0){
+        while(--i >= 0)
+          kfree((void*)PTE2PA(l0[i]));
+        kfree(l0);
+        return -1;
+      }
+      memmove(mem, (char*)pa + i*PGSIZE, PGSIZE);
+      l0[i] = PA2PTE(mem) | flags;
     }
+    *pte = PA2PTE(l0) | PTE_V;
+  }
+  kfree_order((void*)pa, MEGAORDER);
+  return 0;
+}
+
+// If va lies in a user megapage, map it with 512 ordinary
+// pages instead, so that they can be unmapped one at a time.
+// A megapage that fork() shared is copied.
+// Returns -1 if memory runs out.
+static int
+uvmsplit(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte;
+  pagetable_t l0;
+  uint64 pa;
+  uint flags;
+
+  if((pte = megapte(pagetable, va)) == 0)
+    return 0;
+  pa = PTE2PA(*pte);
+  flags = PTE_FLAGS(*pte);
+  if(krefcnt((void*)pa) > 1){
+    if((flags & PTE_COW) != 0)
+      flags = (flags & ~PTE_COW) | PTE_W;
+    if(megacopy(pte, flags, 1) < 0)
+      return -1;
+    uvmflush(pagetable);
+    return 0;
   }
-  return &pagetable[PX(0, va)];
+  if((l0 = (pagetable_t)kalloc()) == 0)
+    return -1;
+  ksplit((void*)pa, MEGAORDER);
+  for(int i = 0; i < 512; i++)
+    l0[i] = PA2PTE(pa + i*PGSIZE) | flags;
+  *pte = PA2PTE(l0) | PTE_V;
+  uvmflush(pagetable);
+  return 0;
+}
+
+// Split the megapages that straddle start or end, so that
+// [start, end) can be unmapped without the rest of them.
+// Returns -1 if a page-table page can't be allocated; a
+// megapage already split stays mapped as ordinary pages.
+int
+uvmsplitends(pagetable_t pagetable, uint64 start, uint64 end)
+{
+  if(start % MEGASIZE != 0 && start < MAXVA && uvmsplit(pagetable, start) < 0)
+    return -1;
+  if(end % MEGASIZE != 0 && end < MAXVA && uvmsplit(pagetable, end) < 0)
+    return -1;
+  return 0;
 }
 
 // Look up a virtual address, return the physical address,
@@ -116,30 +278,52 @@ uint64
 walkaddr(pagetable_t pagetable, uint64 va)
 {
   pte_t *pte;
-  uint64 pa;
+  uint64 pa, off = 0;
 
   if(va >= MAXVA)
     return 0;
 
-  pte = walk(pagetable, va, 0);
+  pte = walklevel(pagetable, va, 0, 1);
   if(pte == 0)
     return 0;
   if((*pte & PTE_V) == 0)
     return 0;
+  if(PTE_LEAF(*pte))
+    off = PGROUNDDOWN(va) & (MEGASIZE-1);  // within a megapage
+  else
+    pte = &((pagetable_t)PTE2PA(*pte))[PX(0, va)];
+  if((*pte & PTE_V) == 0)
+    return 0;
   if((*pte & PTE_U) == 0)
     return 0;
-  pa = PTE2PA(*pte);
+  pa = PTE2PA(*pte) + off;
   return pa;
 }
 
-// add a mapping to the kernel page table.
+// add a mapping to the kernel page table, using megapages
+// for the parts that are aligned to them.
 // only used when booting.
 // does not flush TLB or enable paging.
 void
 kvmmap(pagetable_t kpgtbl, uint64 va, uint64 pa, uint64 sz, int perm)
 {
-  if(mappages(kpgtbl, va, sz, pa, perm) != 0)
-    panic("kvmmap");
+  uint64 end = va + sz, n;
+  pte_t *pte;
+
+  while(va < end){
+    if(va % MEGASIZE == 0 && pa % MEGASIZE == 0 && end - va >= MEGASIZE){
+      if((pte = walklevel(kpgtbl, va, 1, 1)) == 0 || (*pte & PTE_V))
+        panic("kvmmap");
+      *pte = PA2PTE(pa) | perm | PTE_V;
+      n = MEGASIZE;
+    } else {
+      if(mappages(kpgtbl, va, PGSIZE, pa, perm) != 0)
+        panic("kvmmap");
+      n = PGSIZE;
+    }
+    va += n;
+    pa += n;
+  }
 }
 
 // Create PTEs for virtual addresses starting at va that refer to
@@ -172,22 +356,40 @@ mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
 }
 
 // Remove npages of mappings starting from va. va must be
-// page-aligned. The mappings must exist.
+// page-aligned. Pages that aren't mapped are skipped.
 // Optionally free the physical memory.
-void
+// Returns the number of pages unmapped, or -1, unmapping
+// nothing, if a megapage that straddles the range can't be split.
+int
 uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
 {
   uint64 a;
+  int n = 0;
   pte_t *pte;
 
   if((va % PGSIZE) != 0)
     panic("uvmunmap: not aligned");
 
+  if(uvmsplitends(pagetable, va, va + npages*PGSIZE) < 0)
+    return -1;
+
   for(a = va; a < va + npages*PGSIZE; a += PGSIZE){
-    if((pte = walk(pagetable, a, 0)) == 0)
-      panic("uvmunmap: walk");
-    if((*pte & PTE_V) == 0)
-      panic("uvmunmap: not mapped");
+    // any megapage left lies wholly inside the range.
+    if((pte = megapte(pagetable, a)) != 0){
+      if(do_free)
+        kfree_order((void*)PTE2PA(*pte), MEGAORDER);
+      *pte = 0;
+      n += MEGASIZE / PGSIZE;
+      a += MEGASIZE - PGSIZE;
+      continue;
+    }
+    // heap pages that were never touched aren't mapped;
+    // a stack guard page has only its PTE_GUARD to clear.
+    if((pte = walk(pagetable, a, 0)) == 0 || (*pte & PTE_V) == 0){
+      if(pte)
+        *pte = 0;
+      continue;
+    }
     if(PTE_FLAGS(*pte) == PTE_V)
       panic("uvmunmap: not a leaf");
     if(do_free){
@@ -195,7 +397,11 @@ uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
       kfree((void*)pa);
     }
     *pte = 0;
+    n++;
   }
+  if(n > 0)
+    uvmflush(pagetable);
+  return n;
 }
 
 // create an empty user page table.
@@ -204,10 +410,9 @@ pagetable_t
 uvmcreate()
 {
   pagetable_t pagetable;
-  pagetable = (pagetable_t) kalloc();
+  pagetable = (pagetable_t) kalloc_zeroed();
   if(pagetable == 0)
     return 0;
-  memset(pagetable, 0, PGSIZE);
   return pagetable;
 }
 
@@ -221,12 +426,47 @@ uvmfirst(pagetable_t pagetable, uchar *src, uint sz)
 
   if(sz >= PGSIZE)
     panic("uvmfirst: more than a page");
-  mem = kalloc();
-  memset(mem, 0, PGSIZE);
+  mem = kalloc_zeroed();
   mappages(pagetable, 0, PGSIZE, (uint64)mem, PTE_W|PTE_R|PTE_X|PTE_U);
   memmove(mem, src, sz);
 }
 
+// Account for n pages becoming resident (or, if negative,
+// going away) in pagetable, if it belongs to the current process.
+// Callers add pages before allocating them: returns -1, changing
+// nothing, if that would take the process's namespace over its
+// page limit.
+static int
+heapadd(pagetable_t pagetable, int n)
+{
+  struct proc *p = myproc();
+
+  if(n == 0 || p == 0 || p->pagetable != pagetable)
+    return 0;
+  if(n > 0 && nsreserve(p->ns, NSLIM_PAGES, n) < 0)
+    return -1;
+  if(n < 0)
+    nsrelease(p->ns, NSLIM_PAGES, -n);
+  acquire(&p->lock);
+  p->heap_pages += n;
+  ps_publish(p);
+  release(&p->lock);
+  return 0;
+}
+
+// Unmap [start, end) and drop its resident pages.
+// Returns -1, unmapping nothing, if uvmunmap() can't.
+int
+uvmrelease(pagetable_t pagetable, uint64 start, uint64 end)
+{
+  int n;
+
+  if((n = uvmunmap(pagetable, start, (end - start) / PGSIZE, 1)) < 0)
+    return -1;
+  heapadd(pagetable, -n);
+  return 0;
+}
+
 // Allocate PTEs and physical memory to grow process from oldsz to
 // newsz, which need not be page aligned.  Returns new size or 0 on error.
 uint64
@@ -240,17 +480,11 @@ uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz, int xperm)
 
   oldsz = PGROUNDUP(oldsz);
   for(a = oldsz; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    mem = kalloc_zeroed();
     if(mem == 0){
       uvmdealloc(pagetable, a, oldsz);
       return 0;
-    }else {
-      struct proc* p = myproc();
-      acquire(&p->lock);
-      p->heap_pages++;
-      release(&p->lock);
     }
-    memset(mem, 0, PGSIZE);
     if(mappages(pagetable, a, PGSIZE, (uint64)mem, PTE_R|PTE_U|xperm) != 0){
       kfree(mem);
       uvmdealloc(pagetable, a, oldsz);
@@ -263,41 +497,51 @@ uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz, int xperm)
 // Deallocate user pages to bring the process size from oldsz to
 // newsz.  oldsz and newsz need not be page-aligned, nor does newsz
 // need to be less than oldsz.  oldsz can be larger than the actual
-// process size.  Returns the new process size.
+// process size.  Returns the new process size, which stays
+// oldsz if a megapage can't be split.
 uint64
 uvmdealloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
 {
   if(newsz >= oldsz)
     return oldsz;
 
-  if(PGROUNDUP(newsz) < PGROUNDUP(oldsz)){
-    int npages = (PGROUNDUP(oldsz) - PGROUNDUP(newsz)) / PGSIZE;
-    uvmunmap(pagetable, PGROUNDUP(newsz), npages, 1);
-  }
+  if(PGROUNDUP(newsz) < PGROUNDUP(oldsz) &&
+     uvmrelease(pagetable, PGROUNDUP(newsz), PGROUNDUP(oldsz)) < 0)
+    return oldsz;
 
   return newsz;
 }
 
-// Recursively free page-table pages.
-// All leaf mappings must already have been removed.
-void
-freewalk(pagetable_t pagetable)
+// Free the page-table page at level and those below it.
+static void
+freelevel(pagetable_t pagetable, int level)
 {
   // there are 2^9 = 512 PTEs in a page table.
   for(int i = 0; i < 512; i++){
     pte_t pte = pagetable[i];
-    if((pte & PTE_V) && (pte & (PTE_R|PTE_W|PTE_X)) == 0){
+    if((pte & PTE_V) && !PTE_LEAF(pte)){
       // this PTE points to a lower-level page table.
       uint64 child = PTE2PA(pte);
-      freewalk((pagetable_t)child);
+      freelevel((pagetable_t)child, level - 1);
       pagetable[i] = 0;
     } else if(pte & PTE_V){
-      panic("freewalk: leaf");
+      // uvmunmap() frees megapages whole, so one left
+      // at level 1 would leak 2 MiB.
+      panic(level == 1 ? "freewalk: megapage" : "freewalk: leaf");
     }
   }
   kfree((void*)pagetable);
 }
 
+// Recursively free page-table pages.
+// All leaf mappings, 4 KiB pages and megapages alike,
+// must already have been removed.
+void
+freewalk(pagetable_t pagetable)
+{
+  freelevel(pagetable, 2);
+}
+
 // Free user memory pages,
 // then free page-table pages.
 void
@@ -310,51 +554,260 @@ uvmfree(pagetable_t pagetable, uint64 sz)
 
 // Given a parent process's page table, copy
 // its memory into a child's page table.
-// Copies both the page table and the
-// physical memory.
+// Copies the page table but shares the physical
+// memory, marking writable pages copy-on-write in
+// both page tables.
 // returns 0 on success, -1 on failure.
 // frees any allocated pages on failure.
 int
 uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
 {
-  pte_t *pte;
+  return uvmshare(old, new, 0, sz, 0);
+}
+
+// Map the pages of [start, end) in old at the same addresses in
+// new. If shared, both page tables simply share the pages;
+// otherwise writable ones become copy-on-write in both.
+// returns 0 on success, -1 on failure, leaving none mapped in new.
+int
+uvmshare(pagetable_t old, pagetable_t new, uint64 start, uint64 end, int shared)
+{
+  pte_t *pte, *npte;
   uint64 pa, i;
   uint flags;
-  char *mem;
 
-  for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walk(old, i, 0)) == 0)
-      panic("uvmcopy: pte should exist");
-    if((*pte & PTE_V) == 0)
-      panic("uvmcopy: page not present");
+  for(i = start; i < end; i += PGSIZE){
+    if((pte = megapte(old, i)) != 0){
+      // a private megapage is shared whole, copy-on-write.
+      // shared memory is split, so that the pages stay shared
+      // if one side later unmaps some of them.
+      if(!shared && i % MEGASIZE == 0 && i + MEGASIZE <= end){
+        if((npte = walklevel(new, i, 1, 1)) == 0)
+          goto err;
+        if(*npte & PTE_V)
+          panic("uvmshare: remap");
+        if(*pte & PTE_W)
+          *pte = (*pte & ~PTE_W) | PTE_COW;
+        *npte = *pte;
+        kdup((void*)PTE2PA(*pte));
+        i += MEGASIZE - PGSIZE;
+        continue;
+      }
+      if(uvmsplit(old, i) < 0)
+        goto err;
+    }
+    // skip pages that haven't been touched yet, but
+    // keep the stack guard page.
+    if((pte = walk(old, i, 0)) == 0 || (*pte & PTE_V) == 0){
+      if(pte && (*pte & PTE_GUARD) && uvmclear(new, i) < 0)
+        goto err;
+      continue;
+    }
+    // whichever side writes to a copy-on-write page first
+    // gets its own copy in uvmcow().
+    if(!shared && (*pte & PTE_W))
+      *pte = (*pte & ~PTE_W) | PTE_COW;
     pa = PTE2PA(*pte);
     flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == 0)
+    if(mappages(new, i, PGSIZE, pa, flags) != 0)
       goto err;
-    memmove(mem, (char*)pa, PGSIZE);
-    if(mappages(new, i, PGSIZE, (uint64)mem, flags) != 0){
-      kfree(mem);
-      goto err;
-    }
+    kdup((void*)pa);
   }
+  uvmflush(old);
   return 0;
 
  err:
-  uvmunmap(new, 0, i / PGSIZE, 1);
+  uvmflush(old);
+  uvmunmap(new, start, (i - start) / PGSIZE, 1);
   return -1;
 }
 
-// mark a PTE invalid for user access.
-// used by exec for the user stack guard page.
+// Give the page at va a private, writable copy if it is
+// copy-on-write. Called on a store page fault and by copyout().
+// returns 0 on success, -1 if va isn't a copy-on-write page
+// or memory runs out.
+int
+uvmcow(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte;
+  uint64 pa;
+  uint flags;
+  char *mem;
+
+  if(va >= MAXVA)
+    return -1;
+  pte = walk(pagetable, va, 0);
+  if(pte == 0 || (*pte & (PTE_V|PTE_U|PTE_COW)) != (PTE_V|PTE_U|PTE_COW))
+    return -1;
+  pa = PTE2PA(*pte);
+  flags = (PTE_FLAGS(*pte) & ~PTE_COW) | PTE_W;
+
+  // the last sharer can just take the page back.
+  if(krefcnt((void*)pa) == 1){
+    *pte = PA2PTE(pa) | flags;
+    uvmflush(pagetable);
+    return 0;
+  }
+
+  if(pte == megapte(pagetable, va)){
+    if(megacopy(pte, flags, 0) < 0)
+      return -1;
+    uvmflush(pagetable);
+    return 0;
+  }
+
+  if((mem = kalloc()) == 0)
+    return -1;
+  memmove(mem, (char*)pa, PGSIZE);
+  *pte = PA2PTE(mem) | flags;
+  uvmflush(pagetable);
+  kfree((void*)pa);
+  return 0;
+}
+
+#if USERMEGA
+// Map the whole aligned megapage around va, a heap page or a
+// page of anonymous vma v, if all of it is untouched and
+// belongs to the same region. Returns -1 if it can't.
+static int
+lazymega(struct proc *p, struct vma *v, uint64 va, int perm)
+{
+  uint64 b = MEGAROUNDDOWN(va);
+  pte_t *pte;
+  char *mem;
+
+  if(v){
+    if(b < v->start || b + MEGASIZE > v->end)
+      return -1;
+  } else if(b + MEGASIZE > p->sz || vmaoverlap(p->vmas, b, b + MEGASIZE)){
+    return -1;
+  }
+  if((pte = walklevel(p->pagetable, b, 1, 1)) == 0 || (*pte & PTE_V))
+    return -1;
+  if(heapadd(p->pagetable, MEGASIZE / PGSIZE) < 0)
+    return -1;
+  if((mem = kalloc_order(MEGAORDER)) == 0){
+    heapadd(p->pagetable, -(MEGASIZE / PGSIZE));
+    return -1;
+  }
+  memset(mem, 0, MEGASIZE);
+  *pte = PA2PTE(mem) | PTE_R | PTE_U | perm | PTE_V;
+  uvmflush(p->pagetable);
+  return 0;
+}
+#endif
+
+// Map the page at va of the current process, which was made
+// part of its memory without being allocated: a page of a vma,
+// read from its file, or else a zeroed sbrk() page.
+// Called on a page fault and by copyin()/copyout().
+// returns 0 on success, -1 if va isn't such a page,
+// memory runs out, or the file can't be read.
+int
+uvmlazy(pagetable_t pagetable, uint64 va)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+  pte_t *pte;
+  char *mem;
+  int perm = PTE_W, locked;
+
+  if(p == 0 || p->pagetable != pagetable || va >= MAXVA)
+    return -1;
+  va = PGROUNDDOWN(va);
+  v = vmafind(p->vmas, va);
+  if(v == 0 && va >= p->sz)
+    return -1;
+  // nor is the stack guard page, marked PTE_GUARD.
+  if((pte = walk(pagetable, va, 0)) != 0 && (*pte & (PTE_V|PTE_GUARD)))
+    return -1;
+  if(v){
+    if(v->ip){
+      // reading the file may sleep; see uvmprefault().
+      push_off();
+      locked = mycpu()->noff > 1;
+      pop_off();
+      if(locked)
+        return -1;
+    }
+    perm = v->perm;
+  }
+#if USERMEGA
+  if((v == 0 || v->ip == 0) && lazymega(p, v, va, perm) == 0)
+    return 0;
+#endif
+  if(heapadd(pagetable, 1) < 0)
+    return -1;
+  if(v)
+    mem = vmapage(v, va);
+  else
+    mem = kalloc_zeroed();
+  if(mem == 0){
+    heapadd(pagetable, -1);
+    return -1;
+  }
+  if(mappages(pagetable, va, PGSIZE, (uint64)mem, PTE_R|PTE_U|perm) != 0){
+    kfree(mem);
+    heapadd(pagetable, -1);
+    return -1;
+  }
+  uvmflush(pagetable);
+  return 0;
+}
+
+// Mark the page at va dirty, as a store to it would.
+void
+uvmdirty(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte;
+
+  if(va < MAXVA && (pte = walk(pagetable, va, 0)) != 0 && (*pte & PTE_V))
+    *pte |= PTE_D;
+}
+
+// Read in the file-backed pages of [va, va+len) in the current
+// process that aren't mapped yet. Callers that go on to copy
+// to or from the range while holding a spinlock or an inode
+// lock use this first, since filling those pages sleeps.
 void
+uvmprefault(pagetable_t pagetable, uint64 va, uint64 len)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+  pte_t *pte;
+  uint64 a, end;
+
+  end = va + len;
+  if(end < va)
+    end = MAXVA;
+  for(v = p->vmas; v < &p->vmas[NVMA]; v++){
+    if(v->ip == 0 || end <= v->start || va >= v->end)
+      continue;
+    a = PGROUNDDOWN(va) > v->start ? PGROUNDDOWN(va) : v->start;
+    for(; a < end && a < v->end; a += PGSIZE){
+      if((pte = walk(pagetable, a, 0)) != 0 && (*pte & PTE_V))
+        continue;
+      uvmlazy(pagetable, a);
+    }
+  }
+}
+
+// make the unmapped page at va a stack guard, which stays
+// unmapped: uvmlazy() won't fill it in. used by exec.
+// a mapped page without PTE_U wouldn't do, since supervisor
+// mode can read it, and copyin() does so through UALIAS.
+// returns -1 if a page-table page can't be allocated.
+int
 uvmclear(pagetable_t pagetable, uint64 va)
 {
   pte_t *pte;
   
-  pte = walk(pagetable, va, 0);
-  if(pte == 0)
+  if((pte = walk(pagetable, va, 1)) == 0)
+    return -1;
+  if(*pte & PTE_V)
     panic("uvmclear");
-  *pte &= ~PTE_U;
+  *pte = PTE_GUARD;
+  return 0;
 }
 
 // Copy from kernel to user.
@@ -364,12 +817,34 @@ int
 copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 {
   uint64 n, va0, pa0;
+  pte_t *pte;
+
+  // let the MMU translate, unless a page isn't mapped yet,
+  // is copy-on-write, or the mirror is stale; then walk the
+  // page table here, which handles all of those.
+  if(ucopyok(pagetable, dstva, len)){
+    if(ucopy((char*)(UALIAS + dstva), src, len) == 0)
+      return 0;
+    uvmmirror(myproc());
+  }
 
   while(len > 0){
     va0 = PGROUNDDOWN(dstva);
-    pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0)
+    if(va0 >= MAXVA)
+      return -1;
+    pte = walk(pagetable, va0, 0);
+    if((pte == 0 || (*pte & PTE_V) == 0) && uvmlazy(pagetable, va0) == 0)
+      pte = walk(pagetable, va0, 0);
+    if(pte == 0 || (*pte & PTE_V) == 0 || (*pte & PTE_U) == 0)
+      return -1;
+    if((*pte & PTE_COW) && uvmcow(pagetable, va0) < 0)
+      return -1;
+    if((*pte & PTE_W) == 0)
       return -1;
+    // writing through the physical address doesn't set PTE_D,
+    // which tells vmawriteback() what to save.
+    *pte |= PTE_D;
+    pa0 = walkaddr(pagetable, va0);
     n = PGSIZE - (dstva - va0);
     if(n > len)
       n = len;
@@ -390,9 +865,18 @@ copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 {
   uint64 n, va0, pa0;
 
+  // see copyout().
+  if(ucopyok(pagetable, srcva, len)){
+    if(ucopy(dst, (char*)(UALIAS + srcva), len) == 0)
+      return 0;
+    uvmmirror(myproc());
+  }
+
   while(len > 0){
     va0 = PGROUNDDOWN(srcva);
     pa0 = walkaddr(pagetable, va0);
+    if(pa0 == 0 && uvmlazy(pagetable, va0) == 0)
+      pa0 = walkaddr(pagetable, va0);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
@@ -417,9 +901,19 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
   uint64 n, va0, pa0;
   int got_null = 0;
 
+  // see copyout().
+  if(ucopyok(pagetable, srcva, max)){
+    if((got_null = ucopystr(dst, (char*)(UALIAS + srcva), max)) >= 0)
+      return got_null ? 0 : -1;
+    got_null = 0;
+    uvmmirror(myproc());
+  }
+
   while(got_null == 0 && max > 0){
     va0 = PGROUNDDOWN(srcva);
     pa0 = walkaddr(pagetable, va0);
+    if(pa0 == 0 && uvmlazy(pagetable, va0) == 0)
+      pa0 = walkaddr(pagetable, va0);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
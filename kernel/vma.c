@@ -0,0 +1,335 @@
+// Regions of user memory filled in on first touch.
+//
+// exec() doesn't read a program's segments into memory; it
+// records each one as a vma in p->vmas, holding a reference
+// to the program's inode. mmap() adds vmas above the heap for
+// file and anonymous mappings. The first touch of a page in a
+// vma faults, and uvmlazy() maps the page that vmapage()
+// returns. Pages of private writable regions are private copies
+// read from the file; other file pages come from the page cache
+// (pagecache.c), so processes mapping the same file share them.
+//
+// Pages of MAP_SHARED regions stay shared with the children of
+// fork(); anonymous shared regions are filled in by mmap() so
+// that they are there to share. Dirty pages of shared file
+// regions are written back to the file through the log when
+// they are unmapped, without growing the file.
+//
+// A vma's inode reference is dropped with iput(), which needs
+// a transaction, so vmaput() must not be called inside one.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "proc.h"
+#include "mman.h"
+#include "defs.h"
+
+// Claim a free slot in the NVMA-entry table vmas for the
+// page-aligned range [start, end). The caller fills in the
+// file. Returns 0 if the table is full.
+struct vma*
+vmaadd(struct vma *vmas, uint64 start, uint64 end, int perm)
+{
+  struct vma *v;
+
+  for(v = vmas; v < &vmas[NVMA]; v++){
+    if(v->start == v->end){
+      memset(v, 0, sizeof(*v));
+      v->start = start;
+      v->end = end;
+      v->perm = perm;
+      return v;
+    }
+  }
+  return 0;
+}
+
+// The vma containing va, or 0.
+struct vma*
+vmafind(struct vma *vmas, uint64 va)
+{
+  struct vma *v;
+
+  for(v = vmas; v < &vmas[NVMA]; v++)
+    if(va >= v->start && va < v->end)
+      return v;
+  return 0;
+}
+
+// A region in vmas that overlaps [start, end), or 0.
+struct vma*
+vmaoverlap(struct vma *vmas, uint64 start, uint64 end)
+{
+  struct vma *v;
+
+  for(v = vmas; v < &vmas[NVMA]; v++)
+    if(v->start != v->end && start < v->end && v->start < end)
+      return v;
+  return 0;
+}
+
+// Return a page with the contents of v's page at va, for the
+// caller to map. Returns 0 if out of memory or the file
+// can't be read.
+char*
+vmapage(struct vma *v, uint64 va)
+{
+  uint64 off = PGROUNDDOWN(va) - v->start;
+  char *mem;
+  uint n = 0;
+  int r;
+
+  if(v->ip && off < v->filesz){
+    n = v->filesz - off;
+    if(n > PGSIZE)
+      n = PGSIZE;
+  }
+  if(n > 0 && ((v->perm & PTE_W) == 0 || (v->flags & VMA_SHARED)))
+    return pcget(v->ip, v->off + off, n);
+
+  if((mem = kalloc_zeroed()) == 0)
+    return 0;
+  if(n > 0){
+    ilock(v->ip);
+    r = readi(v->ip, 0, (uint64)mem, v->off + off, n);
+    iunlock(v->ip);
+    if(r < 0){
+      kfree(mem);
+      return 0;
+    }
+  }
+  return mem;
+}
+
+// Copy the table src into dst, as for fork().
+void
+vmadup(struct vma *dst, struct vma *src)
+{
+  for(int i = 0; i < NVMA; i++){
+    dst[i] = src[i];
+    if(dst[i].ip)
+      idup(dst[i].ip);
+  }
+}
+
+// Copy the pages of the mmap() regions in vmas from old to new,
+// as for fork(). Returns 0 on success, -1 if out of memory,
+// with none of them left in new.
+int
+vmacopy(pagetable_t old, pagetable_t new, struct vma *vmas)
+{
+  struct vma *v, *u;
+
+  for(v = vmas; v < &vmas[NVMA]; v++){
+    if((v->flags & VMA_MMAP) == 0)
+      continue;
+    if(uvmshare(old, new, v->start, v->end, v->flags & VMA_SHARED) < 0){
+      for(u = vmas; u < v; u++)
+        if(u->flags & VMA_MMAP)
+          uvmunmap(new, u->start, (u->end - u->start) / PGSIZE, 1);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Write the dirty pages of [start, end) in shared file region v
+// back to the file, as far as the file goes.
+static void
+vmawriteback(pagetable_t pagetable, struct vma *v, uint64 start, uint64 end)
+{
+  // like filewrite(), keep each transaction within the log.
+  uint max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
+  uint64 a;
+  pte_t *pte;
+  uint off, i, n;
+
+  for(a = start; a < end; a += PGSIZE){
+    pte = walk(pagetable, a, 0);
+    if(pte == 0 || (*pte & PTE_V) == 0 || (*pte & PTE_D) == 0)
+      continue;
+    off = v->off + (a - v->start);
+    for(i = 0; i < PGSIZE; i += n){
+      begin_op();
+      ilock(v->ip);
+      n = 0;
+      if(off + i < v->ip->size){
+        n = PGSIZE - i;
+        if(n > max)
+          n = max;
+        if(n > v->ip->size - (off + i))
+          n = v->ip->size - (off + i);
+        writei(v->ip, 0, PTE2PA(*pte) + i, off + i, n);
+      }
+      iunlock(v->ip);
+      end_op();
+      if(n == 0)
+        break;
+    }
+  }
+}
+
+// Remove [start, end), which lies within mmap() region v, from
+// pagetable and from v, writing back shared file pages.
+static void
+vmacut(pagetable_t pagetable, struct vma *vmas, struct vma *v, uint64 start, uint64 end)
+{
+  struct vma *tail;
+
+  if(pagetable){
+    if(v->ip && (v->flags & VMA_SHARED) && (v->perm & PTE_W))
+      vmawriteback(pagetable, v, start, end);
+    // can't fail: a range that cuts a megapage comes from
+    // munmap(), which has split it already.
+    uvmrelease(pagetable, start, end);
+  }
+
+  if(start > v->start && end < v->end){
+    // a hole in the middle: the part above becomes its own vma.
+    // munmap() made sure there is a free slot.
+    tail = vmaadd(vmas, end, v->end, v->perm);
+    tail->flags = v->flags;
+    tail->ip = v->ip ? idup(v->ip) : 0;
+    tail->off = v->off + (end - v->start);
+    tail->filesz = v->filesz;
+    v->end = start;
+  } else if(start > v->start){
+    v->end = start;
+  } else if(end < v->end){
+    v->off += end - v->start;
+    v->start = end;
+  } else {
+    v->start = v->end = 0;
+    if(v->ip){
+      begin_op();
+      iput(v->ip);
+      end_op();
+      v->ip = 0;
+    }
+  }
+}
+
+// Release every region in vmas, unmapping the pages of mmap()
+// regions from pagetable (if not 0).
+void
+vmaput(pagetable_t pagetable, struct vma *vmas)
+{
+  struct vma *v;
+
+  for(v = vmas; v < &vmas[NVMA]; v++){
+    if(v->start == v->end)
+      continue;
+    if(v->flags & VMA_MMAP){
+      vmacut(pagetable, vmas, v, v->start, v->end);
+    } else if(v->ip){
+      begin_op();
+      iput(v->ip);
+      end_op();
+    }
+    memset(v, 0, sizeof(*v));
+  }
+}
+
+// Map len bytes of f at offset off (or zeroes if f is 0) into
+// the current process, near addr if that range is free.
+// Returns the address, or -1.
+uint64
+mmap(uint64 addr, uint64 len, int prot, int flags, struct file *f, uint off)
+{
+  struct proc *p = myproc();
+  uint64 base = PGROUNDUP(p->sz);
+  struct vma *v;
+  pte_t *pte;
+  int perm = 0;
+
+  len = PGROUNDUP(len);
+  if(len == 0 || len > USTATS - base || off % PGSIZE != 0)
+    return -1;
+  if(((flags & MAP_SHARED) != 0) == ((flags & MAP_PRIVATE) != 0))
+    return -1;
+  if(prot & PROT_WRITE)
+    perm |= PTE_W;
+  if(prot & PROT_EXEC)
+    perm |= PTE_X;
+  if(f){
+    if(f->type != FD_INODE || !f->readable)
+      return -1;
+    if((flags & MAP_SHARED) && (prot & PROT_WRITE) && !f->writable)
+      return -1;
+  }
+
+  // take addr if it's free, else the highest free range
+  // below USTATS.
+  if(addr % PGSIZE != 0 || addr < base || addr > USTATS - len ||
+     vmaoverlap(p->vmas, addr, addr + len)){
+    addr = USTATS - len;
+    while((v = vmaoverlap(p->vmas, addr, addr + len)) != 0){
+      if(v->start < base + len)
+        return -1;
+      addr = v->start - len;
+    }
+  }
+
+  if((v = vmaadd(p->vmas, addr, addr + len, perm)) == 0)
+    return -1;
+  v->flags = VMA_MMAP | ((flags & MAP_SHARED) ? VMA_SHARED : 0);
+  if(f){
+    v->ip = idup(f->ip);
+    v->off = off;
+    v->filesz = len;
+  } else if(flags & MAP_SHARED){
+    // fill in shared anonymous memory now, so that
+    // children share it whether or not it was touched.
+    for(uint64 a = addr; a < addr + len; a += PGSIZE){
+      // a megapage mapped for an earlier page covers this one.
+      if((pte = walk(p->pagetable, a, 0)) != 0 && (*pte & PTE_V))
+        continue;
+      if(uvmlazy(p->pagetable, a) < 0){
+        vmacut(p->pagetable, p->vmas, v, v->start, v->end);
+        return -1;
+      }
+    }
+  }
+  return addr;
+}
+
+// Unmap [addr, addr+len) from the mmap() regions of the
+// current process. Returns 0, or -1 if the arguments are bad.
+int
+munmap(uint64 addr, uint64 len)
+{
+  struct proc *p = myproc();
+  struct vma *v, *w;
+  uint64 start, end;
+
+  len = PGROUNDUP(len);
+  if(addr % PGSIZE != 0 || len == 0 || addr + len < addr)
+    return -1;
+
+  // split megapages cut by the range up front, so that
+  // nothing below can fail half way.
+  if(uvmsplitends(p->pagetable, addr, addr + len) < 0)
+    return -1;
+
+  for(v = p->vmas; v < &p->vmas[NVMA]; v++){
+    if((v->flags & VMA_MMAP) == 0 || addr >= v->end || v->start >= addr + len)
+      continue;
+    start = addr > v->start ? addr : v->start;
+    end = addr + len < v->end ? addr + len : v->end;
+    if(start > v->start && end < v->end){
+      // splitting v needs a free slot.
+      for(w = p->vmas; w < &p->vmas[NVMA] && w->start != w->end; w++)
+        ;
+      if(w == &p->vmas[NVMA])
+        return -1;
+    }
+    vmacut(p->pagetable, p->vmas, v, start, end);
+  }
+  return 0;
+}
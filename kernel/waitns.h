@@ -0,0 +1,3 @@
+// Flags for the wait_ns system call.
+#define WNS_NOHANG  1   // return at once, with pid 0, if nothing exited
+#define WNS_REAP    2   // also free the process, if it is the caller's child
@@ -0,0 +1,83 @@
+// Page allocator stress test.
+// Runs 1, 2, 4, ... up to maxproc workers in parallel; each
+// one grows and shrinks its heap with sbrk and forks children
+// that exit at once, so that kalloc() and kfree() are hit from
+// every hart. Prints the throughput for each worker count.
+// usage: allocstress [maxproc]
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+
+#define NROUND  100   // rounds per worker
+#define NPAGES  32    // pages added and removed per round
+
+void
+worker(void)
+{
+  for(int i = 0; i < NROUND; i++){
+    char *p = sbrk(NPAGES * PGSIZE);
+    if(p == (char*)-1){
+      printf("allocstress: sbrk failed\n");
+      exit(1);
+    }
+    for(int j = 0; j < NPAGES; j++)
+      p[j * PGSIZE] = j;
+    sbrk(-NPAGES * PGSIZE);
+
+    int pid = fork();
+    if(pid < 0){
+      printf("allocstress: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0)
+      exit(0);
+    wait(0);
+  }
+}
+
+void
+run(int nproc)
+{
+  int start = uptime();
+
+  for(int i = 0; i < nproc; i++){
+    int pid = fork();
+    if(pid < 0){
+      printf("allocstress: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      worker();
+      exit(0);
+    }
+  }
+  for(int i = 0; i < nproc; i++)
+    wait(0);
+
+  int elapsed = uptime() - start;
+  int total = nproc * NROUND;
+  if(elapsed == 0)
+    elapsed = 1;
+  printf("%d workers: %d rounds in %d ticks, %d rounds/100 ticks\n",
+         nproc, total, elapsed, total * 100 / elapsed);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int maxproc = NCPU;
+
+  if(argc > 1)
+    maxproc = atoi(argv[1]);
+  if(maxproc < 1){
+    printf("usage: allocstress [maxproc]\n");
+    exit(1);
+  }
+
+  for(int n = 1; n < maxproc; n *= 2)
+    run(n);
+  run(maxproc);
+  exit(0);
+}
@@ -0,0 +1,37 @@
+// Report physical memory occupancy and how fragmented
+// the free memory is: the number of free blocks of each
+// buddy order.
+
+#include "kernel/types.h"
+#include "kernel/riscv.h"
+#include "kernel/memstat.h"
+#include "user/user.h"
+
+int
+main(int argc, char *argv[])
+{
+  struct memstat ms;
+
+  if(memstat(&ms) < 0){
+    printf("buddyinfo: memstat failed\n");
+    exit(1);
+  }
+
+  uint64 used = ms.total - ms.free - ms.cached - ms.zeroed;
+  printf("pages: %d total, %d used, %d free, %d in cpu caches, %d zeroed\n",
+         (int)ms.total, (int)used, (int)ms.free, (int)ms.cached, (int)ms.zeroed);
+  printf("shared text pages cached: %d\n", (int)ms.pagecache);
+  printf("order\tpages\tblocks\n");
+  for(int k = 0; k < NORDER; k++)
+    printf("%d\t%d\t%d\n", k, 1 << k, (int)ms.nblock[k]);
+
+  // the largest block free tells how big a contiguous
+  // allocation can currently succeed.
+  int max = -1;
+  for(int k = 0; k < NORDER; k++)
+    if(ms.nblock[k])
+      max = k;
+  if(max >= 0)
+    printf("largest free block: %d KB\n", (PGSIZE << max) / 1024);
+  exit(0);
+}
@@ -0,0 +1,63 @@
+// Cost of creating namespaces while many others exist.
+// Times rounds of clone/exit/wait, first alone and then with
+// nhold namespaces kept alive by processes blocked on a pipe.
+// usage: clonebench [nhold]
+
+#include "kernel/types.h"
+#include "user/user.h"
+
+#define NROUND  500   // clones per measurement
+
+int
+timeclones(void)
+{
+  int start = uptime();
+
+  for(int i = 0; i < NROUND; i++){
+    int pid = clone();
+    if(pid < 0){
+      printf("clonebench: clone failed\n");
+      exit(1);
+    }
+    if(pid == 0)
+      exit(0);
+    wait(0);
+  }
+  return uptime() - start;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nhold = 30, held = 0, fds[2];
+  char c;
+
+  if(argc > 1)
+    nhold = atoi(argv[1]);
+  if(pipe(fds) < 0){
+    printf("clonebench: pipe failed\n");
+    exit(1);
+  }
+
+  printf("%d clones with no other namespaces: %d ticks\n", NROUND, timeclones());
+
+  // each holder lives in a namespace of its own until
+  // the pipe is closed.
+  for(; held < nhold; held++){
+    int pid = clone();
+    if(pid < 0)
+      break;
+    if(pid == 0){
+      close(fds[1]);
+      read(fds[0], &c, 1);
+      exit(0);
+    }
+  }
+  close(fds[0]);
+  printf("%d clones with %d other namespaces: %d ticks\n", NROUND, held, timeclones());
+
+  close(fds[1]);
+  while(wait(0) > 0)
+    ;
+  exit(0);
+}
@@ -0,0 +1,99 @@
+// Copy throughput through the kernel's user-copy paths:
+// a pipe between two processes, and writing and reading
+// back a file. Each line reports kilobytes per tick; compare
+// against a kernel whose copyin()/copyout() walk the page
+// table for every page.
+// usage: copybench [kilobytes]
+
+#include "kernel/types.h"
+#include "kernel/fcntl.h"
+#include "kernel/fs.h"
+#include "user/user.h"
+
+#define CHUNK  4096
+#define TMPFILE "copybench.tmp"
+
+char buf[CHUNK];
+
+void
+report(char *what, int kb, int ticks)
+{
+  if(ticks == 0)
+    ticks = 1;
+  printf("%s: %d KB in %d ticks, %d KB/tick\n", what, kb, ticks, kb / ticks);
+}
+
+void
+pipebench(int kb)
+{
+  int fds[2], n, total = 0;
+
+  if(pipe(fds) < 0){
+    printf("copybench: pipe failed\n");
+    exit(1);
+  }
+  int start = uptime();
+  int pid = fork();
+  if(pid < 0){
+    printf("copybench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    close(fds[0]);
+    for(int i = 0; i < kb * 1024 / CHUNK; i++)
+      if(write(fds[1], buf, CHUNK) != CHUNK)
+        exit(1);
+    exit(0);
+  }
+  close(fds[1]);
+  while((n = read(fds[0], buf, CHUNK)) > 0)
+    total += n;
+  close(fds[0]);
+  wait(0);
+  report("pipe", total / 1024, uptime() - start);
+}
+
+void
+filebench(int kb)
+{
+  int fd, n, total = 0;
+
+  if((fd = open(TMPFILE, O_CREATE|O_TRUNC|O_WRONLY)) < 0){
+    printf("copybench: can't create %s\n", TMPFILE);
+    exit(1);
+  }
+  int start = uptime();
+  for(int i = 0; i < kb * 1024 / CHUNK; i++)
+    if(write(fd, buf, CHUNK) != CHUNK){
+      printf("copybench: write failed\n");
+      exit(1);
+    }
+  close(fd);
+  report("file write", kb, uptime() - start);
+
+  fd = open(TMPFILE, O_RDONLY);
+  start = uptime();
+  while((n = read(fd, buf, CHUNK)) > 0)
+    total += n;
+  close(fd);
+  report("file read", total / 1024, uptime() - start);
+  unlink(TMPFILE);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int kb = 1024;
+
+  if(argc > 1)
+    kb = atoi(argv[1]);
+  if(kb < 4){
+    printf("usage: copybench [kilobytes]\n");
+    exit(1);
+  }
+  memset(buf, 'x', sizeof(buf));
+  pipebench(kb);
+  // a file can't grow past MAXFILE blocks.
+  filebench(kb < MAXFILE*BSIZE/1024 ? kb : MAXFILE*BSIZE/1024);
+  exit(0);
+}
@@ -0,0 +1,53 @@
+// exec latency benchmark.
+// Times fork+exec of this program, which carries a large
+// initialized array. With -x the child exits at once and never
+// touches the array; with -t it reads all of it first. With
+// demand paging only the first case should get cheaper.
+
+#include "kernel/types.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+
+#define NROUND  50
+#define BLOBSZ  (32*1024)
+
+char blob[BLOBSZ] = { 1 };   // initialized, so it's in the file
+
+void
+run(char *mode)
+{
+  char *args[] = { "execbench", mode, 0 };
+  int start = uptime();
+
+  for(int i = 0; i < NROUND; i++){
+    int pid = fork();
+    if(pid < 0){
+      printf("execbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      exec(args[0], args);
+      printf("execbench: exec failed\n");
+      exit(1);
+    }
+    wait(0);
+  }
+  printf("exec %s: %d rounds in %d ticks\n", mode, NROUND, uptime() - start);
+}
+
+int
+main(int argc, char *argv[])
+{
+  if(argc > 1 && strcmp(argv[1], "-x") == 0)
+    exit(0);
+  if(argc > 1 && strcmp(argv[1], "-t") == 0){
+    int sum = 0;
+    for(int i = 0; i < BLOBSZ; i += PGSIZE)
+      sum += blob[i];
+    exit(sum == 0);
+  }
+
+  run("-x");
+  run("-t");
+  exit(0);
+}
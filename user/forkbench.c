@@ -0,0 +1,52 @@
+// fork+exec latency as the parent's memory grows.
+// For each size the parent grows its heap, touches every
+// page, and then forks children that immediately exec
+// this program with -x, which exits at once.
+
+#include "kernel/types.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+
+#define NROUND  50   // fork+exec rounds per size
+
+int sizes[] = { 0, 64, 256, 1024, 4096 };   // extra heap pages
+
+int
+main(int argc, char *argv[])
+{
+  char *args[] = { "forkbench", "-x", 0 };
+  int grown = 0;
+
+  if(argc > 1 && strcmp(argv[1], "-x") == 0)
+    exit(0);
+
+  for(int s = 0; s < sizeof(sizes)/sizeof(sizes[0]); s++){
+    char *p = sbrk((sizes[s] - grown) * PGSIZE);
+    if(p == (char*)-1){
+      printf("forkbench: sbrk failed\n");
+      exit(1);
+    }
+    for(int i = 0; i < sizes[s] - grown; i++)
+      p[i * PGSIZE] = i;
+    grown = sizes[s];
+
+    int start = uptime();
+    for(int i = 0; i < NROUND; i++){
+      int pid = fork();
+      if(pid < 0){
+        printf("forkbench: fork failed\n");
+        exit(1);
+      }
+      if(pid == 0){
+        exec(args[0], args);
+        printf("forkbench: exec failed\n");
+        exit(1);
+      }
+      wait(0);
+    }
+    int elapsed = uptime() - start;
+    printf("%d KB heap: %d fork+exec in %d ticks\n",
+           sizes[s] * PGSIZE / 1024, NROUND, elapsed);
+  }
+  exit(0);
+}
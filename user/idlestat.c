@@ -0,0 +1,41 @@
+// Report how much of the time each hart spent idle in wfi,
+// and how often it was woken, over an interval.
+// usage: idlestat [interval-ticks]
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/cpustat.h"
+#include "user/user.h"
+
+struct cpustat before[NCPU], after[NCPU];
+
+int
+main(int argc, char *argv[])
+{
+  int interval = 10;
+
+  if(argc > 1)
+    interval = atoi(argv[1]);
+  if(interval < 1){
+    printf("usage: idlestat [interval-ticks]\n");
+    exit(1);
+  }
+
+  int n = cpustat(before, NCPU);
+  sleep(interval);
+  if(n < 0 || cpustat(after, NCPU) != n){
+    printf("idlestat: cpustat failed\n");
+    exit(1);
+  }
+
+  printf("HART\tIDLE%%\tWAKEUPS\n");
+  for(int i = 0; i < n; i++){
+    uint64 time = after[i].time - before[i].time;
+    uint64 idle = after[i].idle - before[i].idle;
+    if(time == 0)
+      time = 1;
+    printf("%d\t%d\t%d\n", (int)after[i].hart, (int)(idle * 100 / time),
+           (int)(after[i].wakeups - before[i].wakeups));
+  }
+  exit(0);
+}
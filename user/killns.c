@@ -0,0 +1,20 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+// Kill every process in the namespace of each pid,
+// and in the namespaces nested in it.
+int
+main(int argc, char **argv)
+{
+  int i;
+
+  if(argc < 2){
+    fprintf(2, "usage: killns pid...\n");
+    exit(1);
+  }
+  for(i=1; i<argc; i++)
+    if(nskillall(atoi(argv[i])) < 0)
+      fprintf(2, "killns: %s failed\n", argv[i]);
+  exit(0);
+}
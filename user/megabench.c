@@ -0,0 +1,50 @@
+// Time first touch and page-strided reads over a large heap.
+// With USERMEGA set the kernel backs aligned 2 MiB stretches
+// of the heap with megapages, so there are 512 times fewer
+// page faults and far fewer TLB misses; build with USERMEGA 0
+// to compare against ordinary pages.
+// usage: megabench [megabytes]
+
+#include "kernel/types.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+
+#define NPASS  20   // strided read passes
+
+int
+main(int argc, char *argv[])
+{
+  uint64 len = 16, pad;
+  char *p;
+  int sum = 0;
+
+  if(argc > 1)
+    len = atoi(argv[1]);
+  if(len == 0){
+    printf("usage: megabench [megabytes]\n");
+    exit(1);
+  }
+  len <<= 20;
+
+  // start the region on a megapage boundary.
+  pad = (MEGASIZE - (uint64)sbrk(0) % MEGASIZE) % MEGASIZE;
+  if(sbrk(pad) == (char*)-1 || (p = sbrk(len)) == (char*)-1){
+    printf("megabench: sbrk failed\n");
+    exit(1);
+  }
+
+  int start = uptime();
+  for(uint64 i = 0; i < len; i += PGSIZE)
+    p[i] = i / PGSIZE;
+  int touch = uptime() - start;
+
+  start = uptime();
+  for(int n = 0; n < NPASS; n++)
+    for(uint64 i = 0; i < len; i += PGSIZE)
+      sum += p[i];
+  int read = uptime() - start;
+
+  printf("megabench: %d MB, first touch %d ticks, %d read passes %d ticks (%d)\n",
+         (int)(len >> 20), touch, NPASS, read, sum & 1);
+  exit(0);
+}
@@ -0,0 +1,86 @@
+// Compare memset(), memmove() and memcmp() from ulib.c,
+// which work a word at a time, against plain byte loops,
+// on whole pages and on unaligned buffers.
+// usage: membench [rounds]
+
+#include "kernel/types.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+
+char src[PGSIZE + 8] __attribute__((aligned(8)));
+char dst[PGSIZE + 8] __attribute__((aligned(8)));
+
+void*
+bytememset(void *dst, int c, uint n)
+{
+  char *d = dst;
+  for(uint i = 0; i < n; i++)
+    d[i] = c;
+  return dst;
+}
+
+void*
+bytememmove(void *dst, const void *src, int n)
+{
+  char *d = dst;
+  const char *s = src;
+  while(n-- > 0)
+    *d++ = *s++;
+  return dst;
+}
+
+int
+bytememcmp(const void *v1, const void *v2, uint n)
+{
+  const char *p1 = v1, *p2 = v2;
+  for(; n > 0; n--, p1++, p2++)
+    if(*p1 != *p2)
+      return *p1 - *p2;
+  return 0;
+}
+
+int rounds = 20000;
+
+void
+bench(char *what, int off, void (*byte)(int), void (*word)(int))
+{
+  int start = uptime();
+  for(int i = 0; i < rounds; i++)
+    byte(off);
+  int tbyte = uptime() - start;
+  start = uptime();
+  for(int i = 0; i < rounds; i++)
+    word(off);
+  int tword = uptime() - start;
+  printf("%s%s: bytes %d ticks, words %d ticks\n",
+         what, off ? " (offset 3)" : "", tbyte, tword);
+}
+
+void set1(int off) { bytememset(dst + off, 0, PGSIZE); }
+void setw(int off) { memset(dst + off, 0, PGSIZE); }
+void move1(int off) { bytememmove(dst + off, src + off, PGSIZE); }
+void movew(int off) { memmove(dst + off, src + off, PGSIZE); }
+void cmp1(int off) { bytememcmp(dst + off, src + off, PGSIZE); }
+void cmpw(int off) { memcmp(dst + off, src + off, PGSIZE); }
+
+int
+main(int argc, char *argv[])
+{
+  if(argc > 1)
+    rounds = atoi(argv[1]);
+  if(rounds < 1){
+    printf("usage: membench [rounds]\n");
+    exit(1);
+  }
+
+  // the aligned runs are whole-page operations; the
+  // unaligned ones start three bytes in.
+  memset(src, 'x', sizeof(src));
+  for(int off = 0; off <= 3; off += 3){
+    bench("memset", off, set1, setw);
+    bench("memmove", off, move1, movew);
+    memmove(dst, src, sizeof(dst));
+    bench("memcmp", off, cmp1, cmpw);
+  }
+  exit(0);
+}
@@ -0,0 +1,161 @@
+// Exercise mmap() and munmap(): reading a file through a
+// private mapping, writing it through a shared one (by stores
+// and by read()), and anonymous shared memory across fork().
+
+#include "kernel/types.h"
+#include "kernel/fcntl.h"
+#include "kernel/mman.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+
+#define FILESZ (2*PGSIZE + 100)
+
+void
+fail(char *what)
+{
+  printf("mmaptest: %s failed\n", what);
+  exit(1);
+}
+
+void
+makefile(char *name)
+{
+  char buf[100];
+  int fd;
+
+  unlink(name);
+  if((fd = open(name, O_CREATE | O_RDWR)) < 0)
+    fail("create");
+  for(int i = 0; i < FILESZ; i += sizeof(buf)){
+    memset(buf, 'a' + (i / PGSIZE), sizeof(buf));
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf))
+      fail("write");
+  }
+  close(fd);
+}
+
+void
+filetest(void)
+{
+  char *p;
+  int fd;
+
+  makefile("mmap.tmp");
+  if((fd = open("mmap.tmp", O_RDWR)) < 0)
+    fail("open");
+
+  // private: reads see the file, writes stay here.
+  p = mmap(0, FILESZ, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if(p == MAP_FAILED)
+    fail("mmap private");
+  if(p[0] != 'a' || p[PGSIZE] != 'b' || p[2*PGSIZE + 99] != 'c')
+    fail("private read");
+  if(p[2*PGSIZE + 100] != 0 || p[3*PGSIZE - 1] != 0)
+    fail("zero past end of file");
+  p[0] = 'X';
+  if(munmap(p, FILESZ) < 0)
+    fail("munmap private");
+
+  // shared: writes reach the file on munmap.
+  p = mmap(0, FILESZ, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if(p == MAP_FAILED)
+    fail("mmap shared");
+  if(p[0] != 'a')
+    fail("private write leaked");
+  p[0] = 'Y';
+  p[PGSIZE + 1] = 'Z';
+  if(munmap(p, FILESZ) < 0)
+    fail("munmap shared");
+  close(fd);
+
+  char buf[PGSIZE + 2];
+  if((fd = open("mmap.tmp", O_RDONLY)) < 0)
+    fail("reopen");
+  if(read(fd, buf, sizeof(buf)) != sizeof(buf))
+    fail("read back");
+  if(buf[0] != 'Y' || buf[PGSIZE + 1] != 'Z')
+    fail("write back");
+  close(fd);
+  unlink("mmap.tmp");
+  printf("mmaptest: file mappings ok\n");
+}
+
+// read() into a shared mapping that was never touched
+// writes its pages without a store from user space.
+void
+readtest(void)
+{
+  char buf[PGSIZE + 1], *p;
+  int fd, src;
+
+  makefile("mmap.tmp");
+  unlink("mmap2.tmp");
+  if((src = open("mmap2.tmp", O_CREATE | O_RDWR)) < 0)
+    fail("create source");
+  memset(buf, 'q', PGSIZE);
+  if(write(src, buf, PGSIZE) != PGSIZE)
+    fail("write source");
+  close(src);
+
+  if((fd = open("mmap.tmp", O_RDWR)) < 0 || (src = open("mmap2.tmp", O_RDONLY)) < 0)
+    fail("open");
+  p = mmap(0, FILESZ, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if(p == MAP_FAILED)
+    fail("mmap shared");
+  if(read(src, p, PGSIZE) != PGSIZE)
+    fail("read into mapping");
+  if(munmap(p, FILESZ) < 0)
+    fail("munmap shared");
+  close(src);
+  close(fd);
+
+  if((fd = open("mmap.tmp", O_RDONLY)) < 0)
+    fail("reopen");
+  if(read(fd, buf, sizeof(buf)) != sizeof(buf))
+    fail("read back");
+  if(buf[0] != 'q' || buf[PGSIZE - 1] != 'q' || buf[PGSIZE] != 'b')
+    fail("write back of read()");
+  close(fd);
+  unlink("mmap.tmp");
+  unlink("mmap2.tmp");
+  printf("mmaptest: read into mappings ok\n");
+}
+
+void
+anontest(void)
+{
+  int *shared, *private;
+
+  shared = mmap(0, PGSIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  private = mmap(0, PGSIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(shared == MAP_FAILED || private == MAP_FAILED)
+    fail("mmap anonymous");
+  *shared = 1;
+  *private = 1;
+
+  int pid = fork();
+  if(pid < 0)
+    fail("fork");
+  if(pid == 0){
+    *shared = 2;
+    *private = 2;
+    exit(0);
+  }
+  wait(0);
+  if(*shared != 2)
+    fail("shared anonymous");
+  if(*private != 1)
+    fail("private anonymous");
+  munmap(shared, PGSIZE);
+  munmap(private, PGSIZE);
+  printf("mmaptest: anonymous mappings ok\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  filetest();
+  readtest();
+  anontest();
+  exit(0);
+}
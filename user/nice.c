@@ -0,0 +1,23 @@
+// Run a command at a lower scheduling priority.
+// usage: nice level command [args...]
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/priority.h"
+#include "user/user.h"
+
+int
+main(int argc, char *argv[])
+{
+  if(argc < 3){
+    printf("usage: nice level command [args...]\n");
+    exit(1);
+  }
+  if(setpriority(PRIO_PROCESS, 0, atoi(argv[1])) < 0){
+    printf("nice: level must be 0 to %d\n", NPRIO - 1);
+    exit(1);
+  }
+  exec(argv[2], &argv[2]);
+  printf("nice: exec %s failed\n", argv[2]);
+  exit(1);
+}
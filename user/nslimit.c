@@ -0,0 +1,72 @@
+// Run a command in a new namespace with resource limits,
+// or with no arguments show those of the current namespace.
+// A limit of 0 means none.
+// usage: nslimit [procs pages files command [args...]]
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/nslimit.h"
+#include "user/user.h"
+
+static char *names[NSLIM] = {
+  [NSLIM_PROC]  "procs",
+  [NSLIM_PAGES] "pages",
+  [NSLIM_FILES] "files",
+};
+
+int
+main(int argc, char *argv[])
+{
+  struct nsusage u;
+  int fds[2];
+  char c;
+
+  if(argc == 1){
+    if(nsusage(0, &u) < 0){
+      printf("nslimit: nsusage failed\n");
+      exit(1);
+    }
+    printf("RESOURCE\tUSED\tLIMIT\n");
+    for(int i = 0; i < NSLIM; i++)
+      printf("%s\t\t%d\t%d\n", names[i], u.used[i], u.limit[i]);
+    exit(0);
+  }
+  if(argc < 5){
+    printf("usage: nslimit [procs pages files command [args...]]\n");
+    exit(1);
+  }
+
+  // the child waits on the pipe until its limits are set.
+  if(pipe(fds) < 0){
+    printf("nslimit: pipe failed\n");
+    exit(1);
+  }
+  int pid = clone();
+  if(pid < 0){
+    printf("nslimit: clone failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    close(fds[1]);
+    if(read(fds[0], &c, 1) != 1)
+      exit(1);
+    close(fds[0]);
+    exec(argv[4], &argv[4]);
+    printf("nslimit: exec %s failed\n", argv[4]);
+    exit(1);
+  }
+
+  close(fds[0]);
+  for(int i = 0; i < NSLIM; i++){
+    if(setnslimit(pid, i, atoi(argv[1 + i])) < 0){
+      printf("nslimit: can't limit %s\n", names[i]);
+      nskill(pid);
+    }
+  }
+  write(fds[1], "x", 1);
+  close(fds[1]);
+
+  int status;
+  wait(&status);
+  exit(status);
+}
@@ -0,0 +1,88 @@
+// Fair sharing of the cpu between namespaces.
+// Starts two tenants, each in a namespace of its own and
+// running some CPU-bound processes, and shows how many ticks
+// each namespace used. With equal weights they should get
+// about the same, however many processes each runs.
+// usage: nsshare [nA [nB [weightA]]]
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/process_info.h"
+#include "user/user.h"
+
+#define NSPIN  100   // ticks the tenants compute for
+
+volatile int sink;
+
+void
+spin(int end)
+{
+  while(uptime() < end)
+    for(int j = 0; j < 100000; j++)
+      sink++;
+}
+
+// start a namespace running n spinners until end.
+// returns the pid of its first process.
+int
+tenant(int n, int end)
+{
+  int pid = clone();
+
+  if(pid < 0){
+    printf("nsshare: clone failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    for(int i = 1; i < n; i++){
+      if(fork() == 0){
+        spin(end);
+        exit(0);
+      }
+    }
+    spin(end);
+    while(wait(0) > 0)
+      ;
+    exit(0);
+  }
+  return pid;
+}
+
+int
+main(int argc, char *argv[])
+{
+  static struct process_info infos[NPROC];
+  int na = 6, nb = 1, weight = NSWEIGHT;
+  int pids[2], ticks[2] = { 0, 0 };
+
+  if(argc > 1)
+    na = atoi(argv[1]);
+  if(argc > 2)
+    nb = atoi(argv[2]);
+  if(argc > 3)
+    weight = atoi(argv[3]);
+  if(na < 1 || nb < 1){
+    printf("usage: nsshare [nA [nB [weightA]]]\n");
+    exit(1);
+  }
+
+  int end = uptime() + NSPIN;
+  pids[0] = tenant(na, end);
+  pids[1] = tenant(nb, end);
+  if(setnsweight(pids[0], weight) < 0)
+    printf("nsshare: setnsweight %d failed\n", weight);
+
+  // sample while both are still busy.
+  sleep(NSPIN - 10);
+  int n = ps_snapshot(infos, NPROC, 0);
+  for(int i = 0; i < n && i < NPROC; i++)
+    for(int t = 0; t < 2; t++)
+      if(infos[i].ns_pid == pids[t])
+        ticks[t] = infos[i].ns_ticks;
+
+  printf("A: %d processes, weight %d, %d ticks\n", na, weight, ticks[0]);
+  printf("B: %d processes, weight %d, %d ticks\n", nb, NSWEIGHT, ticks[1]);
+  while(wait(0) > 0)
+    ;
+  exit(0);
+}
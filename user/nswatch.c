@@ -0,0 +1,31 @@
+// Print the exits of processes in this namespace and the
+// namespaces nested in it, as wait_ns() reports them.
+// With -r, also reap those that are our children.
+// usage: nswatch [-r] [count]
+
+#include "kernel/types.h"
+#include "kernel/waitns.h"
+#include "user/user.h"
+
+int
+main(int argc, char *argv[])
+{
+  int flags = 0, count = -1, status, pid;
+
+  if(argc > 1 && strcmp(argv[1], "-r") == 0){
+    flags |= WNS_REAP;
+    argc--;
+    argv++;
+  }
+  if(argc > 1)
+    count = atoi(argv[1]);
+
+  for(int i = 0; count < 0 || i < count; i++){
+    if(wait_ns(flags, &status, &pid) < 0){
+      printf("nswatch: wait_ns failed\n");
+      exit(1);
+    }
+    printf("pid %d exited with status %d\n", pid, status);
+  }
+  exit(0);
+}
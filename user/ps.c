@@ -35,69 +35,63 @@ void process_pids() {
 }
 
 void process_list(){
-    int limit = 100;
-	int pids[limit];  // global pids
-	int pids_ns[limit];  // namespace pids
-	for (int i = 0; i < limit; ++i) {
-        pids[i] = -1;
-	    pids_ns[i] = -1;
-	}
-	  
-	int count_ps = ps_list_global(limit, pids);
-	if (count_ps < 0) {
-	    printf("ps_list (global): internal error\n"); 
-	}
-	if (count_ps > limit) {
-	    printf("ps_list: too many processes\n");
-	    exit(-1);
-	}
-	  
-	int res = ps_list(limit, pids_ns);
-	if (res < 0) {
-	    printf("ps_list (namespace): internal error\n"); 
-	}
-
-
-
-
+    // one ps_snapshot call returns every record; retry if
+    // processes were created between sizing and filling the buffer.
+    int limit = ps_snapshot(NULL, 0, 0);
+    struct process_info* infos = NULL;
+    int count_ps = -1;
+    while (limit >= 0) {
+        infos = malloc((limit + 1) * sizeof(struct process_info));
+        if (infos == NULL) {
+            printf("ps: out of memory\n");
+            exit(-1);
+        }
+        count_ps = ps_snapshot(infos, limit + 1, 0);
+        if (count_ps <= limit + 1)
+            break;
+        free(infos);
+        infos = NULL;
+        limit = count_ps;
+    }
+    if (count_ps < 0) {
+        printf("ps_snapshot: internal error\n");
+        exit(-1);
+    }
 
     for (int i = 0; i < count_ps; ++i) {
-        struct process_info psinfo = {}; // Initialize all fields
-        int res = ps_info(pids[i], &psinfo); // Retrieve process info
-
-        if (res == -1) {
-            printf("ps_info: cannot get info about global pid = %d\n\n", pids[i]);
-        } else {
-            // Display all process information
-            printf(
-                "info about pid = %d in namespace %d:\n"
-                "state -> %s\n"
-                "PPID -> %d\n"
-                "mem -> %d bytes\n"
-                "files_count -> %d\n"
-                "name -> %s\n"
-                "/////TIME/////:\n"
-                "proc_ticks -> %d\n"
-                "run_time -> %d\n"
-                "context_switches -> %d\n"
-                "user -> %d\n"
-                "kernel -> %d\n"
-                "waiting -> %d\n"
-                "/////MEMINFO/////:\n"
-                "read -> %d\n"
-                "write -> %d\n"
-                "pages -> %d\n"
-                "ps_info return value -> %d\n\n",
-                pids[i], pids_ns[i],
-                psinfo.state, psinfo.parent_pid, psinfo.mem_size, 
-                psinfo.files_count, psinfo.proc_name, 
-                psinfo.proc_ticks, psinfo.run_time, psinfo.context_switches,
-                psinfo.user_ticks, psinfo.kernel_ticks, psinfo.waiting_ticks,
-                psinfo.bytes_read, psinfo.bytes_write, psinfo.pages_count,
-                res
-            );
-        }
+        struct process_info* psinfo = &infos[i];
+        // Display all process information
+        printf(
+            "info about pid = %d in namespace %d:\n"
+            "state -> %s\n"
+            "PPID -> %d\n"
+            "mem -> %d bytes\n"
+            "files_count -> %d\n"
+            "name -> %s\n"
+            "/////TIME/////:\n"
+            "proc_ticks -> %d\n"
+            "run_time -> %d\n"
+            "context_switches -> %d\n"
+            "user -> %d\n"
+            "kernel -> %d\n"
+            "waiting -> %d\n"
+            "priority -> %d (nice %d)\n"
+            "namespace -> weight %d, %d ticks\n"
+            "/////MEMINFO/////:\n"
+            "read -> %d\n"
+            "write -> %d\n"
+            "pages -> %d\n\n",
+            psinfo->pid, psinfo->ns_pid,
+            psinfo->state, psinfo->parent_pid, psinfo->mem_size,
+            psinfo->files_count, psinfo->proc_name,
+            psinfo->proc_ticks, psinfo->run_time, psinfo->context_switches,
+            psinfo->user_ticks, psinfo->kernel_ticks, psinfo->waiting_ticks,
+            psinfo->priority, psinfo->nice,
+            psinfo->ns_weight, psinfo->ns_ticks,
+            psinfo->bytes_read, psinfo->bytes_write, psinfo->pages_count
+        );
     }
+    free(infos);
 }
 
 int main(int argc, char *argv[]) {
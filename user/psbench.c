@@ -0,0 +1,79 @@
+// Compare the cost of listing processes with
+// ps_list + ps_list_global + one ps_info per pid
+// against a single ps_snapshot call.
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/process_info.h"
+#include "user/user.h"
+
+#define NCHILD  20   // idle processes to populate the table
+#define NROUND  200  // listings per method
+#define MAXPS   NPROC
+
+int pids[MAXPS];
+int ns_pids[MAXPS];
+struct process_info infos[MAXPS];
+
+void
+old_listing(void)
+{
+  struct process_info pi;
+
+  int n = ps_list_global(MAXPS, pids);
+  ps_list(MAXPS, ns_pids);
+  if(n > MAXPS)
+    n = MAXPS;
+  for(int i = 0; i < n; i++)
+    ps_info(pids[i], &pi);
+}
+
+void
+new_listing(void)
+{
+  ps_snapshot(infos, MAXPS, 0);
+}
+
+int
+timeit(void (*f)(void))
+{
+  int start = uptime();
+  for(int i = 0; i < NROUND; i++)
+    f();
+  return uptime() - start;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int fds[2];
+  char c;
+
+  // children block on the pipe until we close it.
+  if(pipe(fds) < 0){
+    printf("psbench: pipe failed\n");
+    exit(1);
+  }
+  for(int i = 0; i < NCHILD; i++){
+    int pid = fork();
+    if(pid < 0)
+      break;
+    if(pid == 0){
+      close(fds[1]);
+      read(fds[0], &c, 1);
+      exit(0);
+    }
+  }
+  close(fds[0]);
+
+  printf("psbench: %d processes visible\n", ps_snapshot(0, 0, 0));
+  int told = timeit(old_listing);
+  int tnew = timeit(new_listing);
+  printf("ps_list + ps_info: %d rounds in %d ticks\n", NROUND, told);
+  printf("ps_snapshot:       %d rounds in %d ticks\n", NROUND, tnew);
+
+  close(fds[1]);
+  while(wait(0) > 0)
+    ;
+  exit(0);
+}
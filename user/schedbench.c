@@ -0,0 +1,80 @@
+// Scheduler throughput benchmark.
+// Runs nproc workers that fork/exit/wait or yield in a loop,
+// and reports how many operations finished per clock tick.
+// Run it under different CPUS= settings to see how the
+// scheduler scales with the number of harts.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define NFORK   200   // fork/wait rounds per worker
+#define NYIELD  5000  // yields per worker
+
+void
+forkworker(void)
+{
+  for(int i = 0; i < NFORK; i++){
+    int pid = fork();
+    if(pid < 0){
+      printf("schedbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0)
+      exit(0);
+    wait(0);
+  }
+}
+
+void
+yieldworker(void)
+{
+  for(int i = 0; i < NYIELD; i++)
+    yield();
+}
+
+// start nproc copies of worker, wait for all of them,
+// and print the throughput.
+void
+run(char *name, void (*worker)(void), int nproc, int nops)
+{
+  int start = uptime();
+
+  for(int i = 0; i < nproc; i++){
+    int pid = fork();
+    if(pid < 0){
+      printf("schedbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      worker();
+      exit(0);
+    }
+  }
+  for(int i = 0; i < nproc; i++)
+    wait(0);
+
+  int elapsed = uptime() - start;
+  int total = nproc * nops;
+  if(elapsed == 0)
+    elapsed = 1;
+  printf("%s: %d workers, %d ops in %d ticks, %d ops/tick\n",
+         name, nproc, total, elapsed, total / elapsed);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nproc = 4;
+
+  if(argc > 1)
+    nproc = atoi(argv[1]);
+  if(nproc < 1){
+    printf("usage: schedbench [nproc]\n");
+    exit(1);
+  }
+
+  run("fork", forkworker, nproc, NFORK);
+  run("yield", yieldworker, nproc, NYIELD);
+  exit(0);
+}
@@ -0,0 +1,88 @@
+// Scheduling latency of interactive work under CPU load.
+// Starts nspin CPU-bound processes and one that repeatedly
+// sleeps a tick and computes briefly, then shows how much
+// each ran and waited at every priority level.
+// Run it from the root namespace, where pids are global.
+// usage: schedlat [nspin]
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/process_info.h"
+#include "user/user.h"
+
+#define NWAKE  50    // sleeps by the interactive process
+#define NSPIN  100   // ticks each spinner computes for
+
+volatile int sink;
+
+// print this process's per-level run and wait times.
+void
+report(char *what)
+{
+  struct process_info pi;
+
+  if(ps_info(getpid(), &pi) < 0){
+    printf("schedlat: ps_info failed\n");
+    return;
+  }
+  printf("%s %d: ran %d, waited %d, %d switches\n", what, pi.pid,
+         pi.run_time, pi.waiting_ticks, pi.context_switches);
+  for(int k = 0; k < NPRIO; k++)
+    printf("  level %d: ran %d, waited %d\n", k, pi.prio_run[k], pi.prio_wait[k]);
+}
+
+void
+spinner(void)
+{
+  int end = uptime() + NSPIN;
+
+  while(uptime() < end)
+    for(int j = 0; j < 100000; j++)
+      sink++;
+}
+
+void
+interactive(void)
+{
+  for(int i = 0; i < NWAKE; i++){
+    sleep(1);
+    for(int j = 0; j < 10000; j++)
+      sink++;
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nspin = 4;
+
+  if(argc > 1)
+    nspin = atoi(argv[1]);
+  if(nspin < 0){
+    printf("usage: schedlat [nspin]\n");
+    exit(1);
+  }
+
+  for(int i = 0; i <= nspin; i++){
+    int pid = fork();
+    if(pid < 0){
+      printf("schedlat: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      // the last child is the interactive one.
+      if(i == nspin){
+        interactive();
+        report("interactive");
+      } else {
+        spinner();
+        if(i == 0)
+          report("spinner");
+      }
+      exit(0);
+    }
+  }
+  while(wait(0) > 0)
+    ;
+  exit(0);
+}
@@ -1,6 +1,8 @@
 #include "kernel/types.h"
+#include "kernel/param.h"
 #include "user/user.h"
 #include "kernel/process_info.h"
+#include "kernel/waitns.h"
 
 // !!
 // This tests were written by Ulyana, I only fixed print_procs
@@ -616,6 +618,166 @@ test_task_panic_ns(char *s) {
 }
 
 
+// nskillall kills a namespace and those nested in it.
+void
+test_nskillall(char *s) {
+  printf("\nRun test for nskillall\n");
+  int pid1 = clone();
+  if (pid1 < 0) {
+    printf("%s: clone failed\n", s);
+    exit(1);
+  }
+
+
+  // child code: two processes here, each with
+  // a child in a nested namespace.
+  if (pid1 == 0) {
+    fork();
+    if (clone() == 0) {
+      sleep(1000);
+      exit(0);
+    }
+    sleep(1000);
+    exit(0);
+  }
+
+
+  sleep(5);
+  int n = nskillall(pid1);
+  printf("\tKilled %d processes\n", n);
+  if (n != 4) {
+    printf("%s: expected 4\n", s);
+    exit(1);
+  }
+  wait(0);
+  if (check_pid_exist(pid1)) {
+    printf("%s: pid %d still exists\n", s, pid1);
+    exit(1);
+  }
+  if (nskillall(getpid()) >= 0) {
+    printf("%s: killed its own namespace\n", s);
+    exit(1);
+  }
+}
+
+
+// cpu ticks used so far by the namespace whose first
+// process is pid, or -1.
+int
+ns_ticks_of(int pid) {
+  static struct process_info infos[NPROC];
+  int n = ps_snapshot(infos, NPROC, 0);
+  for (int i = 0; i < n && i < NPROC; i++)
+    if (infos[i].ns_pid == pid)
+      return infos[i].ns_ticks;
+  return -1;
+}
+
+
+// spin in n processes until uptime end, then exit.
+void
+spin_until(int n, int end) {
+  for (int i = 1; i < n; i++) {
+    if (fork() == 0)
+      break;
+  }
+  while (uptime() < end)
+    ;
+  while (wait(0) > 0)
+    ;
+  exit(0);
+}
+
+
+// a namespace that wakes up after sitting idle catches up
+// by a bounded amount, and its busy sibling keeps running.
+void
+test_nsshare_idle(char *s) {
+  printf("\nRun test for fair share after idling\n");
+  int idle = 50, window = 30;
+  int end = uptime() + idle + window + 10;
+
+  int busy = clone();
+  if (busy == 0)
+    spin_until(NCPU, end);
+  int late = clone();
+  if (late == 0) {
+    sleep(idle);
+    spin_until(NCPU, end);
+  }
+  if (busy < 0 || late < 0) {
+    printf("%s: clone failed\n", s);
+    exit(1);
+  }
+
+  sleep(idle + 2);
+  int t0 = ns_ticks_of(busy);
+  sleep(window);
+  int t1 = ns_ticks_of(busy);
+  printf("\tbusy namespace got %d ticks after the other woke\n", t1 - t0);
+  while (wait(0) > 0)
+    ;
+  if (t0 < 0 || t1 - t0 < window / 4) {
+    printf("%s: busy namespace starved\n", s);
+    exit(1);
+  }
+}
+
+
+// wait_ns reports exits in the caller's namespace and those
+// nested in it, with pids in the caller's namespace.
+void
+test_wait_ns(char *s) {
+  printf("\nRun test for wait_ns\n");
+  int pid1 = clone();
+  if (pid1 < 0) {
+    printf("%s: clone failed\n", s);
+    exit(1);
+  }
+
+
+  // child code: a fresh namespace, so only our exits show up
+  if (pid1 == 0) {
+    int status, pid;
+    if (wait_ns(WNS_NOHANG, &status, &pid) < 0 || pid != 0) {
+      printf("%s: event before any exit\n", s);
+      exit(1);
+    }
+
+    int pid2 = fork();
+    if (pid2 == 0)
+      exit(7);
+    if (wait_ns(WNS_REAP, &status, &pid) < 0 || pid != pid2 || status != 7) {
+      printf("%s: got pid %d status %d, expected %d 7\n", s, pid, status, pid2);
+      exit(1);
+    }
+    if (wait(0) >= 0) {
+      printf("%s: child %d not reaped\n", s, pid2);
+      exit(1);
+    }
+
+    // the nested namespace's first process has the pid
+    // clone returned here.
+    int pid3 = clone();
+    if (pid3 == 0)
+      exit(9);
+    if (wait_ns(0, &status, &pid) < 0 || pid != pid3 || status != 9) {
+      printf("%s: got pid %d status %d, expected %d 9\n", s, pid, status, pid3);
+      exit(1);
+    }
+    wait(0);
+    printf("\twait_ns ok\n");
+    exit(0);
+  }
+
+
+  int status;
+  wait(&status);
+  if (status != 0)
+    exit(1);
+}
+
+
 int
 main(int argc, char *argv[])
 {
@@ -630,6 +792,9 @@ main(int argc, char *argv[])
   test_task_6("Test clone task 6");
   test_task_7("Test clone task 7");
   test_task_panic_ns("Test deep limit");
+  test_nskillall("Test nskillall");
+  test_wait_ns("Test wait_ns");
+  test_nsshare_idle("Test fair share after idling");
   printf("All done.\n");
   return 0;
 }
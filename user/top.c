@@ -0,0 +1,61 @@
+// Sample per-process statistics from the kernel's read-only
+// USTATS page, without making a system call per process.
+// usage: top [rounds [interval-ticks]]
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/riscv.h"
+#include "kernel/memlayout.h"
+#include "kernel/procstat.h"
+#include "user/user.h"
+
+static char *states[] = { "unused", "used", "sleep", "runble", "run", "zombie" };
+
+// copy slot i consistently, or return 0 if it is unused.
+int
+readslot(volatile struct procstat *st, struct procstat *out)
+{
+  uint seq;
+
+  for(;;){
+    seq = st->seq;
+    __sync_synchronize();
+    if(seq & 1)
+      continue;
+    memmove(out, (void*)st, sizeof(*out));
+    __sync_synchronize();
+    if(st->seq == seq)
+      return out->pid != 0;
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  volatile struct procstat *page = (volatile struct procstat *)USTATS;
+  struct procstat st;
+  int rounds = 1, interval = 10;
+
+  if(argc > 1)
+    rounds = atoi(argv[1]);
+  if(argc > 2)
+    interval = atoi(argv[2]);
+
+  for(int r = 0; r < rounds; r++){
+    if(r > 0)
+      sleep(interval);
+    printf("PID\tSTATE\tPRIO\tRUN\tSWITCH\tWAIT\tREAD\tWRITE\tPAGES\tNAME\n");
+    for(int i = 0; i < NPROC; i++){
+      if(!readslot(&page[i], &st))
+        continue;
+      char *state = "???";
+      if(st.state >= 0 && st.state < sizeof(states)/sizeof(states[0]))
+        state = states[st.state];
+      printf("%d\t%s\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%s\n",
+             st.pid, state, st.prio, st.run_time, st.context_switches,
+             st.waiting_time, st.read_b, st.write_b, st.heap_pages,
+             st.name);
+    }
+  }
+  exit(0);
+}
@@ -43,14 +43,27 @@ strlen(const char *s)
   return n;
 }
 
+// memset(), memmove() and memcmp() go eight bytes at a time
+// once the pointers are aligned, and 64 at a time after that.
 void*
 memset(void *dst, int c, uint n)
 {
   char *cdst = (char *) dst;
-  int i;
-  for(i = 0; i < n; i++){
-    cdst[i] = c;
+  uint64 w = (uchar)c * 0x0101010101010101UL;
+  uint64 *wdst;
+
+  for(; n > 0 && ((uint64)cdst & 7); n--)
+    *cdst++ = c;
+  wdst = (uint64 *) cdst;
+  for(; n >= 64; n -= 64, wdst += 8){
+    wdst[0] = w; wdst[1] = w; wdst[2] = w; wdst[3] = w;
+    wdst[4] = w; wdst[5] = w; wdst[6] = w; wdst[7] = w;
   }
+  for(; n >= 8; n -= 8)
+    *wdst++ = w;
+  cdst = (char *) wdst;
+  while(n-- > 0)
+    *cdst++ = c;
   return dst;
 }
 
@@ -118,15 +131,41 @@ memmove(void *vdst, const void *vsrc, int n)
 {
   char *dst;
   const char *src;
+  uint64 *wdst;
+  const uint64 *wsrc;
+  int words;
 
   dst = vdst;
   src = vsrc;
+  words = (((uint64)src ^ (uint64)dst) & 7) == 0;
   if (src > dst) {
+    if (words) {
+      for (; n > 0 && ((uint64)dst & 7); n--)
+        *dst++ = *src++;
+      wdst = (uint64 *) dst;
+      wsrc = (const uint64 *) src;
+      for (; n >= 64; n -= 64, wdst += 8, wsrc += 8) {
+        wdst[0] = wsrc[0]; wdst[1] = wsrc[1]; wdst[2] = wsrc[2]; wdst[3] = wsrc[3];
+        wdst[4] = wsrc[4]; wdst[5] = wsrc[5]; wdst[6] = wsrc[6]; wdst[7] = wsrc[7];
+      }
+      for (; n >= 8; n -= 8)
+        *wdst++ = *wsrc++;
+      dst = (char *) wdst;
+      src = (const char *) wsrc;
+    }
     while(n-- > 0)
       *dst++ = *src++;
   } else {
     dst += n;
     src += n;
+    if (words) {
+      for (; n > 0 && ((uint64)dst & 7); n--)
+        *--dst = *--src;
+      for (; n >= 8; n -= 8) {
+        dst -= 8, src -= 8;
+        *(uint64 *)dst = *(const uint64 *)src;
+      }
+    }
     while(n-- > 0)
       *--dst = *--src;
   }
@@ -137,6 +176,13 @@ int
 memcmp(const void *s1, const void *s2, uint n)
 {
   const char *p1 = s1, *p2 = s2;
+  if ((((uint64)p1 | (uint64)p2) & 7) == 0) {
+    while (n >= 8 && *(const uint64 *)p1 == *(const uint64 *)p2) {
+      p1 += 8;
+      p2 += 8;
+      n -= 8;
+    }
+  }
   while (n-- > 0) {
     if (*p1 != *p2) {
       return *p1 - *p2;
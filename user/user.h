@@ -1,5 +1,8 @@
 struct stat;
 struct process_info;
+struct memstat;
+struct cpustat;
+struct nsusage;
 
 // system calls
 int fork(void);
@@ -28,8 +31,21 @@ void poweroff(void);
 int ps_list(int, int*);
 int ps_list_global(int, int*);
 int ps_info(int, struct process_info*);
+int ps_snapshot(struct process_info*, int, int);
 int clone(void);
 int getppid(void);
+int yield(void);
+int nskill(int);
+int memstat(struct memstat*);
+void* mmap(void*, uint, int, int, int, uint);
+int munmap(void*, uint);
+int cpustat(struct cpustat*, int);
+int setpriority(int, int, int);
+int setnsweight(int, int);
+int setnslimit(int, int, int);
+int nsusage(int, struct nsusage*);
+int nskillall(int);
+int wait_ns(int, int*, int*);
 
 
 // ulib.c
@@ -41,5 +41,18 @@ entry("poweroff");
 entry("ps_list");
 entry("ps_info");
 entry("ps_list_global");
+entry("ps_snapshot");
 entry("clone");
-entry("getppid");
\ No newline at end of file
+entry("getppid");
+entry("yield");
+entry("nskill");
+entry("memstat");
+entry("mmap");
+entry("munmap");
+entry("cpustat");
+entry("setpriority");
+entry("setnsweight");
+entry("setnslimit");
+entry("nsusage");
+entry("nskillall");
+entry("wait_ns");
\ No newline at end of file